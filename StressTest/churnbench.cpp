@@ -0,0 +1,123 @@
+// 连接抖动基准测试：客户端不停地 建立连接 -> 发送一个请求 -> 收到回复 -> RST关闭，
+// 统计服务器每秒完成的 accept + 创建Connection + 销毁Connection 次数，用来衡量短连接场景下每条连接的固定开销
+// 用法：./churnbench.out [秒数] [客户端线程数] [从事件循环个数] [reuseport(0/1)]
+#include "TcpServer.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const char *serv_ip = "127.0.0.1";
+static const uint16_t serv_port = 60123;
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<uint64_t> g_created(0);
+static std::atomic<uint64_t> g_deleted(0);
+static std::atomic<uint64_t> g_failed(0);
+
+// 一个客户端线程：短连接循环
+static void clientLoop()
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(serv_port);
+    inet_pton(AF_INET, serv_ip, &addr.sin_addr);
+
+    // 4字节长度头（网络字节序） + 内容，和 EchoServer 的协议相同
+    const char body[] = "ping";
+    char req[4 + sizeof(body) - 1];
+    uint32_t len = sizeof(body) - 1;
+    uint32_t netlen = htonl(len);
+    memcpy(req, &netlen, 4);
+    memcpy(req + 4, body, len);
+
+    // SO_LINGER 超时为0，close 时直接发送RST，客户端不会堆积 TIME_WAIT 耗尽端口
+    linger lg{1, 0};
+
+    char resp[64];
+    while (!g_stop.load(std::memory_order_relaxed))
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            send(fd, req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req) ||
+            recv(fd, resp, sizeof(resp), 0) <= 0)
+        {
+            g_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        close(fd);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    setvbuf(stdout, nullptr, _IOLBF, 0); // 日志也输出到标准输出，按行刷新
+
+    int seconds = argc >= 2 ? atoi(argv[1]) : 5;
+    int clients = argc >= 3 ? atoi(argv[2]) : 4;
+    int subloops = argc >= 4 ? atoi(argv[3]) : 2;
+    bool reuseport = argc >= 5 ? atoi(argv[4]) != 0 : false;
+
+    TcpServer server(serv_ip, serv_port, subloops, reuseport);
+    server.sethandlecreateconnectioncb([](const std::shared_ptr<Socket>)
+                                       { g_created.fetch_add(1, std::memory_order_relaxed); });
+    server.sethandledeleteconnectioncb([](int)
+                                       { g_deleted.fetch_add(1, std::memory_order_relaxed); });
+    server.sethandlemessage([](std::shared_ptr<Connection> pConn, Buffer *buf)
+                            {
+                                // 收到完整的请求就原样回复
+                                while (buf->readableBytes() >= 4)
+                                {
+                                    int32_t len = buf->peekInt32();
+                                    if (buf->readableBytes() < 4 + static_cast<size_t>(len))
+                                    {
+                                        break;
+                                    }
+                                    std::string msg(buf->peek(), 4 + len);
+                                    buf->retrieve(4 + len);
+                                    pConn->send(msg);
+                                } });
+
+    std::thread serverThread([&server]()
+                             { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(clientLoop);
+    }
+
+    uint64_t last = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 1; s <= seconds; ++s)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now = g_deleted.load();
+        printf("[%ds] conn/s=%llu\n", s, (unsigned long long)(now - last));
+        last = now;
+    }
+    g_stop.store(true);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("subloops=%d reuseport=%d clients=%d: created=%llu deleted=%llu failed=%llu, %.0f conn/s\n",
+           subloops, reuseport ? 1 : 0, clients,
+           (unsigned long long)g_created.load(), (unsigned long long)g_deleted.load(),
+           (unsigned long long)g_failed.load(), g_deleted.load() / elapsed);
+    fflush(stdout);
+
+    // 基准测试只关心吞吐量，直接退出，不等待事件循环线程
+    _exit(0);
+}
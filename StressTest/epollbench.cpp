@@ -0,0 +1,132 @@
+// Epoll::epollwait 微基准测试：10k 个同时就绪的 fd，对比旧版本（每轮 memset + 分配 vector<Channel*> + 上限1024）
+// 与新版本（直接返回事件数组视图，数组满时自适应扩容）每轮事件循环的开销
+// 用法：./epollbench.out [fd数量] [轮数]
+#include "Epoll.h"
+#include "Channel.h"
+#include "Socket.h"
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+static const int LEGACY_MAXEVENTS = 1024;
+
+// 旧版本 Epoll::epollwait 的实现，作为对照组
+static std::vector<Channel *> legacyWait(int epfd, struct epoll_event *evs, int timeout)
+{
+    std::vector<Channel *> retvec;
+    memset((void *)evs, 0, LEGACY_MAXEVENTS);
+    int cnt = epoll_wait(epfd, evs, LEGACY_MAXEVENTS, timeout);
+    if (cnt <= 0)
+    {
+        return retvec;
+    }
+    retvec.reserve(cnt);
+    for (int i = 0; i < cnt; ++i)
+    {
+        Channel *channel = static_cast<Channel *>(evs[i].data.ptr);
+        channel->sethappenevents(evs[i].events);
+        retvec.push_back(channel);
+    }
+    return retvec;
+}
+
+static double nowns()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char *argv[])
+{
+    int fdnums = argc >= 2 ? atoi(argv[1]) : 10000;
+    int rounds = argc >= 3 ? atoi(argv[2]) : 2000;
+
+    // 保证进程能打开足够多的fd
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < static_cast<rlim_t>(fdnums + 64))
+    {
+        rl.rlim_cur = std::min<rlim_t>(rl.rlim_max, fdnums + 64);
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    // 每个 eventfd 都写入数据，在水平触发模式下会一直处于可读状态
+    std::vector<std::unique_ptr<Channel>> channels;
+    channels.reserve(fdnums);
+    for (int i = 0; i < fdnums; ++i)
+    {
+        int efd = eventfd(1, EFD_NONBLOCK);
+        if (efd == -1)
+        {
+            perror("eventfd");
+            return -1;
+        }
+        channels.emplace_back(std::make_unique<Channel>(nullptr, std::make_shared<Socket>(efd)));
+        channels.back()->setevents(EPOLLIN);
+    }
+
+    // 旧版本
+    int legacyfd = epoll_create(1);
+    struct epoll_event legacyevs[LEGACY_MAXEVENTS];
+    for (auto &ch : channels)
+    {
+        struct epoll_event ev;
+        ev.data.ptr = ch.get();
+        ev.events = ch->getevents();
+        epoll_ctl(legacyfd, EPOLL_CTL_ADD, ch->getfd(), &ev);
+    }
+
+    // 新版本
+    Epoll ep;
+    for (auto &ch : channels)
+    {
+        ep.updatechannel(ch.get());
+    }
+
+    // 预热：让新版本的事件数组扩容到稳定大小
+    int warm = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int timeout = 0;
+        warm = ep.epollwait(timeout).size();
+    }
+
+    uint64_t legacyEvents = 0;
+    double start = nowns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        std::vector<Channel *> ready = legacyWait(legacyfd, legacyevs, 0);
+        legacyEvents += ready.size();
+    }
+    double legacyNs = nowns() - start;
+
+    uint64_t newEvents = 0;
+    start = nowns();
+    for (int i = 0; i < rounds; ++i)
+    {
+        int timeout = 0;
+        EpollEvents events = ep.epollwait(timeout);
+        for (const auto &ev : events)
+        {
+            static_cast<Channel *>(ev.data.ptr)->sethappenevents(ev.events);
+        }
+        newEvents += events.size();
+    }
+    double newNs = nowns() - start;
+
+    printf("active fds: %d, rounds: %d, steady event array size: %d\n", fdnums, rounds, warm);
+    printf("%-8s %14s %14s %14s %18s\n", "version", "ns/iteration", "events/iter", "ns/event", "epoll_wait/drain");
+    printf("%-8s %14.0f %14.1f %14.1f %18.1f\n", "legacy", legacyNs / rounds, (double)legacyEvents / rounds,
+           legacyNs / legacyEvents, (double)fdnums * rounds / legacyEvents);
+    printf("%-8s %14.0f %14.1f %14.1f %18.1f\n", "view", newNs / rounds, (double)newEvents / rounds,
+           newNs / newEvents, (double)fdnums * rounds / newEvents);
+
+    ::close(legacyfd);
+    return 0;
+}
@@ -0,0 +1,62 @@
+// 日志基准测试：若干个线程同时不停地写日志，统计每秒写入的日志条数和丢弃的条数，用来衡量日志前端的开销和线程之间的竞争
+// 用法：./logbench.out [秒数] [线程数] [text|binary]，binary 表示二进制格式，写出的文件用 logdecoder.out 还原
+#include "Log.h"
+#include "AsyncLogging.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static std::atomic<bool> g_stop(false);
+
+int main(int argc, char *argv[])
+{
+    int seconds = argc >= 2 ? atoi(argv[1]) : 5;
+    int threads = argc >= 3 ? atoi(argv[2]) : 8;
+    bool binary = argc >= 4 && strcmp(argv[3], "binary") == 0;
+
+    AsyncLogging *asyncLog = AsyncLogging::getInstance();
+    asyncLog->start();
+    Log::SetOutputFormat(binary ? Log::BINARY : Log::TEXT); // 在设置日志文件之前设置格式
+    Log::SetOutputTarget(Log::FILE, "logbench");
+
+    std::vector<uint64_t> counts(threads, 0);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([i, &counts]()
+                             {
+                                 uint64_t n = 0;
+                                 while (!g_stop.load(std::memory_order_relaxed))
+                                 {
+                                     LOG(info) << "ip=127.0.0.1,port=" << 40000 + i << ",fd=" << n % 1024 << " connected";
+                                     ++n;
+                                 }
+                                 counts[i] = n; });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    g_stop.store(true);
+    for (auto &t : workers)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total = 0;
+    for (uint64_t n : counts)
+    {
+        total += n;
+    }
+    asyncLog->stop();
+
+    printf("%s threads=%d: %llu lines, %.0f lines/s, dropped=%llu\n", binary ? "binary" : "text", threads, (unsigned long long)total,
+           total / elapsed, (unsigned long long)asyncLog->droppedCount());
+    fflush(stdout);
+    return 0;
+}
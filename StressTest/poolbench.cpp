@@ -0,0 +1,104 @@
+// 线程池基准测试：若干个提交线程（模拟I/O线程）不停地向工作线程池提交很小的任务，统计每秒执行完的任务数。
+// 一半的任务在工作线程里再提交一个子任务，覆盖线程池内部提交和窃取的路径。
+// 有序模式下改用 AddOrderedTask，每个提交线程轮流使用 64 个 key，检查同一个 key 的任务是否按提交顺序执行
+// 用法：./poolbench.out [秒数] [工作线程数] [提交线程数] [是否有序]
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<uint64_t> g_submitted(0);
+static std::atomic<uint64_t> g_done(0);
+static std::atomic<uint64_t> g_disorder(0); // 有序模式下乱序执行的任务数
+
+static const size_t kKeysPerProducer = 64;
+
+int main(int argc, char *argv[])
+{
+    setvbuf(stdout, nullptr, _IOLBF, 0); // 日志也输出到标准输出，按行刷新
+
+    int seconds = argc >= 2 ? atoi(argv[1]) : 5;
+    int workers = argc >= 3 ? atoi(argv[2]) : 16;
+    int producers = argc >= 4 ? atoi(argv[3]) : 4;
+    bool ordered = argc >= 5 && atoi(argv[4]) != 0;
+
+    ThreadPool pool(workers, "WORK");
+    pool.setrebalancedepth(ordered ? 1024 : 0);
+
+    // 每个 key 下一个应该执行的序号，只在执行这个 key 的任务时访问，有序时不需要加锁
+    std::vector<uint64_t> expected(producers * kKeysPerProducer, 0);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&pool, &expected, ordered, i]()
+                             {
+                                 std::vector<uint64_t> seqs(kKeysPerProducer, 0);
+                                 uint64_t n = 0;
+                                 while (!g_stop.load(std::memory_order_relaxed))
+                                 {
+                                     // 提交得比执行得快太多时歇一下，避免队列无限增长
+                                     if (g_submitted.load(std::memory_order_relaxed) - g_done.load(std::memory_order_relaxed) > 100000)
+                                     {
+                                         std::this_thread::yield();
+                                         continue;
+                                     }
+
+                                     if (ordered)
+                                     {
+                                         size_t key = i * kKeysPerProducer + (n++ % kKeysPerProducer);
+                                         uint64_t seq = seqs[key % kKeysPerProducer]++;
+                                         g_submitted.fetch_add(1, std::memory_order_relaxed);
+                                         pool.AddOrderedTask(key, [&expected, key, seq]()
+                                                             {
+                                                                 if (expected[key] != seq)
+                                                                 {
+                                                                     g_disorder.fetch_add(1, std::memory_order_relaxed);
+                                                                 }
+                                                                 expected[key] = seq + 1;
+                                                                 g_done.fetch_add(1, std::memory_order_relaxed); });
+                                         continue;
+                                     }
+
+                                     bool nested = (++n & 1) == 0;
+                                     g_submitted.fetch_add(nested ? 2 : 1, std::memory_order_relaxed);
+                                     pool.AddTask([&pool, nested]()
+                                                  {
+                                                      if (nested)
+                                                      {
+                                                          pool.AddTask([]()
+                                                                       { g_done.fetch_add(1, std::memory_order_relaxed); });
+                                                      }
+                                                      g_done.fetch_add(1, std::memory_order_relaxed); });
+                                 } });
+    }
+
+    uint64_t last = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 1; s <= seconds; ++s)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t now = g_done.load();
+        printf("[%ds] tasks/s=%llu\n", s, (unsigned long long)(now - last));
+        last = now;
+    }
+    g_stop.store(true);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 停止线程池会先执行完已经提交的任务
+    pool.stop();
+    printf("workers=%d producers=%d ordered=%d: submitted=%llu done=%llu disorder=%llu, %.0f tasks/s\n",
+           workers, producers, ordered, (unsigned long long)g_submitted.load(), (unsigned long long)g_done.load(),
+           (unsigned long long)g_disorder.load(), g_done.load() / elapsed);
+    fflush(stdout);
+    return g_submitted.load() == g_done.load() && g_disorder.load() == 0 ? 0 : 1;
+}
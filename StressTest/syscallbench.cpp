@@ -0,0 +1,220 @@
+// 系统调用计数基准测试：客户端线程各持有一条长连接，循环 发送一个请求 -> 等待回复，
+// 统计服务器线程每完成一次回声调用了多少次 epoll_wait / epoll_ctl / 读 / 写，用来衡量每个请求的固定系统调用开销。
+// 本程序自己定义了这几个函数，动态链接时会覆盖 libc 里的版本，计数后再通过 dlsym(RTLD_NEXT) 调用真正的实现；
+// 客户端线程的调用不计数
+// 用法：./syscallbench.out [秒数] [客户端连接数] [从事件循环个数]
+#include "TcpServer.h"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const char *serv_ip = "127.0.0.1";
+static const uint16_t serv_port = 60124;
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<bool> g_counting(false); // 预热结束之后才开始计数
+static std::atomic<uint64_t> g_echoes(0);
+
+static std::atomic<uint64_t> g_epollwait(0);
+static std::atomic<uint64_t> g_epollctl(0);
+static std::atomic<uint64_t> g_reads(0);  // read / readv / recv
+static std::atomic<uint64_t> g_writes(0); // write / send / sendmsg
+
+static thread_local bool t_client = false; // 客户端线程不计数
+
+// 服务器线程调用一次被统计的系统调用
+static inline void count(std::atomic<uint64_t> &counter)
+{
+    if (!t_client && g_counting.load(std::memory_order_relaxed))
+    {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// 查找 libc 里真正的实现
+template <typename F>
+static F next(const char *name)
+{
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+extern "C"
+{
+    int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+    {
+        static auto real = next<int (*)(int, struct epoll_event *, int, int)>("epoll_wait");
+        count(g_epollwait);
+        return real(epfd, events, maxevents, timeout);
+    }
+
+    int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) noexcept
+    {
+        static auto real = next<int (*)(int, int, int, struct epoll_event *)>("epoll_ctl");
+        count(g_epollctl);
+        return real(epfd, op, fd, event);
+    }
+
+    ssize_t read(int fd, void *buf, size_t count_)
+    {
+        static auto real = next<ssize_t (*)(int, void *, size_t)>("read");
+        count(g_reads);
+        return real(fd, buf, count_);
+    }
+
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        static auto real = next<ssize_t (*)(int, const struct iovec *, int)>("readv");
+        count(g_reads);
+        return real(fd, iov, iovcnt);
+    }
+
+    ssize_t recv(int fd, void *buf, size_t len, int flags)
+    {
+        static auto real = next<ssize_t (*)(int, void *, size_t, int)>("recv");
+        count(g_reads);
+        return real(fd, buf, len, flags);
+    }
+
+    ssize_t write(int fd, const void *buf, size_t count_)
+    {
+        static auto real = next<ssize_t (*)(int, const void *, size_t)>("write");
+        count(g_writes);
+        return real(fd, buf, count_);
+    }
+
+    ssize_t send(int fd, const void *buf, size_t len, int flags)
+    {
+        static auto real = next<ssize_t (*)(int, const void *, size_t, int)>("send");
+        count(g_writes);
+        return real(fd, buf, len, flags);
+    }
+
+    ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+    {
+        static auto real = next<ssize_t (*)(int, const struct msghdr *, int)>("sendmsg");
+        count(g_writes);
+        return real(fd, msg, flags);
+    }
+}
+
+// 一个客户端线程：一条长连接上的请求-回复循环
+static void clientLoop()
+{
+    t_client = true;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(serv_port);
+    inet_pton(AF_INET, serv_ip, &addr.sin_addr);
+
+    // 4字节长度头（网络字节序） + 内容，和 EchoServer 的协议相同
+    const char body[] = "ping";
+    char req[4 + sizeof(body) - 1];
+    uint32_t len = sizeof(body) - 1;
+    uint32_t netlen = htonl(len);
+    memcpy(req, &netlen, 4);
+    memcpy(req + 4, body, len);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("connect");
+        close(fd);
+        return;
+    }
+
+    char resp[64];
+    while (!g_stop.load(std::memory_order_relaxed))
+    {
+        if (send(fd, req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req))
+        {
+            break;
+        }
+        size_t got = 0;
+        while (got < sizeof(req))
+        {
+            ssize_t n = recv(fd, resp + got, sizeof(resp) - got, 0);
+            if (n <= 0)
+            {
+                close(fd);
+                return;
+            }
+            got += n;
+        }
+        if (g_counting.load(std::memory_order_relaxed))
+        {
+            g_echoes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    setvbuf(stdout, nullptr, _IOLBF, 0); // 日志也输出到标准输出，按行刷新
+
+    int seconds = argc >= 2 ? atoi(argv[1]) : 5;
+    int clients = argc >= 3 ? atoi(argv[2]) : 4;
+    int subloops = argc >= 4 ? atoi(argv[3]) : 1;
+
+    TcpServer server(serv_ip, serv_port, subloops);
+    server.sethandlemessage([](std::shared_ptr<Connection> pConn, Buffer *buf)
+                            {
+                                // 收到完整的请求就原样回复
+                                while (buf->readableBytes() >= 4)
+                                {
+                                    int32_t len = buf->peekInt32();
+                                    if (buf->readableBytes() < 4 + static_cast<size_t>(len))
+                                    {
+                                        break;
+                                    }
+                                    pConn->send(buf->peek(), 4 + len);
+                                    buf->retrieve(4 + len);
+                                } });
+
+    std::thread serverThread([&server]()
+                             { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(clientLoop);
+    }
+
+    // 预热，连接建立阶段的系统调用不计入
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    g_counting.store(true);
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    g_counting.store(false);
+
+    g_stop.store(true);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    uint64_t echoes = g_echoes.load();
+    double per = echoes > 0 ? 1.0 / echoes : 0.0;
+    printf("subloops=%d clients=%d: %llu echoes, %.0f echo/s\n",
+           subloops, clients, (unsigned long long)echoes, echoes / static_cast<double>(seconds));
+    printf("per echo: epoll_wait=%.3f epoll_ctl=%.3f read=%.3f write=%.3f total=%.3f\n",
+           g_epollwait.load() * per, g_epollctl.load() * per, g_reads.load() * per, g_writes.load() * per,
+           (g_epollwait.load() + g_epollctl.load() + g_reads.load() + g_writes.load()) * per);
+    fflush(stdout);
+
+    // 基准测试只关心计数，直接退出，不等待事件循环线程
+    _exit(0);
+}
@@ -1,8 +1,9 @@
 #include "EchoServer.h"
 
-EchoServer::EchoServer(const std::string &ip, uint16_t port, uint16_t subthreads, uint16_t workthreads)
-    : m_tcpserver(ip, port, subthreads), 
-      m_workthreads(workthreads, "WORK")
+EchoServer::EchoServer(const std::string &ip, uint16_t port, uint16_t subthreads, uint16_t workthreads, bool reuseport, PollerType poller,
+                       std::vector<int> iocpus, std::vector<int> workcpus)
+    : m_tcpserver(ip, port, subthreads, reuseport, poller, std::move(iocpus)), 
+      m_workthreads(workthreads, "WORK", std::move(workcpus))
 {
     m_tcpserver.sethandlecreateconnectioncb([this](std::shared_ptr<Socket> pClientSocket)
                                             { HandleNewConnection(pClientSocket); });
@@ -13,11 +14,23 @@ EchoServer::EchoServer(const std::string &ip, uint16_t port, uint16_t subthreads
     m_tcpserver.sethandleeventlooptimeout([this](EventLoop *peloop)
                                           { HandleEventLoopTimeout(peloop); });
 
+    m_codec.setframecb([this](const std::shared_ptr<Connection>& pConn, FrameBatch& frames)
+                       { HandleFrames(pConn, frames); });
+
     m_tcpserver.sethandlemessage([this](std::shared_ptr<Connection> pConn, Buffer* buffer)
-                                 { HandleOnMessage(pConn, buffer); });
+                                 { m_codec.onmessage(pConn, buffer); });
 
     m_tcpserver.sethandlesendcomplete([this](std::shared_ptr<Connection> pConn)
                                       { HandleSendComplete(pConn); });
+
+    // 对端读得慢时，回复积压到 4MB 暂停读这条连接，发送到 1MB 以下再恢复
+    m_tcpserver.setwatermark(4 * 1024 * 1024, 1024 * 1024);
+
+    // 某个工作线程积压超过 1024 批消息时，空闲连接的后续消息可以换到积压最少的工作线程
+    m_workthreads.setrebalancedepth(1024);
+
+    // 单条消息最大不超过 64MB（见 LengthCodec::kDefaultMaxFrame），读缓冲区最多存放一条最大的消息
+    m_tcpserver.setinputlimit(64 * 1024 * 1024 + 4);
 }
 
 EchoServer::~EchoServer()
@@ -38,44 +51,29 @@ void EchoServer::Stop()
     m_tcpserver.stop();
 }
 
-// 处理客户端发送过来的消息
-void EchoServer::HandleOnMessage(std::shared_ptr<Connection> pConn, Buffer* buffer)
+// 处理客户端发送过来的一批完整的消息
+void EchoServer::HandleFrames(const std::shared_ptr<Connection>& pConn, FrameBatch& frames)
 {
-    while (buffer->readableBytes() > 4)
+    if (m_workthreads.size() != 0) // 如果有工作线程，将整批消息交给工作线程处理，转移读缓冲区的所有权，不拷贝
     {
-        int32_t msgLen = buffer->peekInt32(); // 查看数据长度前缀
-        if (buffer->readableBytes() >= 4 + msgLen) // buffer里面有一条完整的TCP数据
-        {
-            buffer->retrieve(4); // 消耗4字节的前缀
-            std::string msg(buffer->retrieveAsString(msgLen)); // 获取数据内容
-
-            // 处理数据/////////////////
-            if (m_workthreads.size() != 0) // 如果有工作线程，将数据处理的操作交给工作线程
-            {
-                m_workthreads.AddTask([this, pConn, msg](){
-                    this->OnMessage(pConn, msg);
-                });
-            }
-            else // 如果没有工作线程，数据的处理由当前运行从事件循环的I/O线程执行
-            {
-                OnMessage(pConn, msg);
-            }
-        }
-        else if (msgLen >= 64 * 1024 * 1024) // 防止炸弹
-        {
-            pConn->closeconnection(); // 关闭这条链接
-        }
-        else // buffer 不是一条完整的数据
+        // 以 fd 为 key 提交有序任务：同一个连接的消息总是在同一个工作线程里按顺序处理，回复不会乱序
+        // beginreply/endreply 让对端关闭写端之后，连接等这批回复发完再关闭
+        std::shared_ptr<FrameBatch> owned = frames.detach();
+        pConn->beginreply();
+        m_workthreads.AddOrderedTask(pConn->fd(), [this, pConn, owned]()
+                                     {
+                                         for (std::string_view msg : *owned)
+                                         {
+                                             OnMessage(pConn, msg);
+                                         }
+                                         pConn->endreply(); });
+    }
+    else // 如果没有工作线程，数据的处理由当前运行从事件循环的I/O线程执行，直接使用读缓冲区里的视图
+    {
+        for (std::string_view msg : frames)
         {
-            break;
+            OnMessage(pConn, msg);
         }
-
-        // std::cout << "处理客户端发送过来的数据的是线程：" << syscall(SYS_gettid) << std::endl;
-
-        // std::stringstream oss;
-        // oss << "[" << TimesTamp::now().tostring() << "]" << " recv(fd=" << pConn->fd()
-        //     << ")" << msg;
-        // std::cout << oss.str() << std::endl;
     }
 }
 
@@ -104,17 +102,21 @@ void EchoServer::HandleEventLoopTimeout(EventLoop *peloop)
 }
 
 // 处理具体业务
-void EchoServer::OnMessage(std::shared_ptr<Connection> pConn, std::string msg)
+void EchoServer::OnMessage(const std::shared_ptr<Connection>& pConn, std::string_view msg)
 {
     // std::cout << "处理具体业务的是线程：" << syscall(SYS_gettid) << std::endl;
     // 处理客户端发送来的每一条数据
-    msg = "reply: " + msg;
-
-    uint32_t msgLen = htonl(msg.size());
-    msg.insert(0, reinterpret_cast<char *>(&msgLen), sizeof(msgLen));
+    static const std::string_view prefix = "reply: ";
+    Buffer reply(prefix.size() + msg.size());
+    reply.append(prefix.data(), prefix.size());
+    reply.append(msg.data(), msg.size());
 
     // std::this_thread::sleep_for(std::chrono::seconds(5));
 
-    // 将处理完的数据发送回客户端
-    pConn->send(msg);
-}
\ No newline at end of file
+    // 将处理完的数据加上长度头，发送回客户端。加上前缀之后超过最大长度的回复发不出去，对端也收不了，断开连接
+    if (!m_codec.send(pConn, std::move(reply)))
+    {
+        pConn->getloop()->addTask([pConn]()
+                                  { pConn->closeconnection(); });
+    }
+}
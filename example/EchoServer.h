@@ -2,11 +2,14 @@
 #pragma once
 
 #include "TcpServer.h"
+#include "LengthCodec.h"
 
 class EchoServer
 {
 public:
-    EchoServer(const std::string &ip, uint16_t port, uint16_t subthreads = 3, uint16_t workthreads = 3);
+    // iocpus、workcpus 分别是I/O线程和工作线程绑定的CPU，为空表示不绑定
+    EchoServer(const std::string &ip, uint16_t port, uint16_t subthreads = 3, uint16_t workthreads = 3, bool reuseport = false, PollerType poller = PollerType::Epoll,
+               std::vector<int> iocpus = {}, std::vector<int> workcpus = {});
     ~EchoServer();
 
     // 启动服务器
@@ -15,8 +18,8 @@ public:
     // 关闭服务器
     void Stop();
 
-    // 处理客户端发送过来的消息
-    void HandleOnMessage(std::shared_ptr<Connection> pConn, Buffer* buffer);
+    // 处理客户端发送过来的一批完整的消息
+    void HandleFrames(const std::shared_ptr<Connection>& pConn, FrameBatch& frames);
 
     // 处理新的客户端连接请求
     void HandleNewConnection(std::shared_ptr<Socket> pClientSocket);
@@ -31,9 +34,10 @@ public:
     void HandleEventLoopTimeout(EventLoop* peloop);
 
     // 处理具体业务
-    void OnMessage(std::shared_ptr<Connection> pConn, std::string msg);
+    void OnMessage(const std::shared_ptr<Connection>& pConn, std::string_view msg);
 
 private:
     TcpServer m_tcpserver; // 服务器类
+    LengthCodec m_codec; // 4字节网络字节序长度头的分帧编解码器
     ThreadPool m_workthreads; // 工作线程池
 };
\ No newline at end of file
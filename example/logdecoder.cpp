@@ -0,0 +1,217 @@
+// 二进制日志解码工具：把 Log::BINARY 格式写出的日志文件还原成和文本格式相同的
+// [级别][PID:线程ID][YYYY-MM-DD HH:MM:SS.微秒][文件:行号][函数名] 内容
+// 用法：./logdecoder.out 日志文件...   还原的文本输出到标准输出，文件按参数的顺序依次解码
+#include "BinaryLog.h"
+#include "TimesTamp.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 调用点定义
+struct Site
+{
+    int level;
+    int line;
+    std::string file;
+    std::string func;
+};
+
+// 把纳秒时间戳格式化成 "YYYY-MM-DD HH:MM:SS.微秒"
+static void appendTime(std::string &out, int64_t nanos)
+{
+    out += TimesTamp(static_cast<time_t>(nanos / 1000000000)).tostring();
+    char micros[16];
+    snprintf(micros, sizeof(micros), ".%06ld", static_cast<long>(nanos % 1000000000 / 1000));
+    out += micros;
+}
+
+// 按 Log 的 operator<< 的文本格式还原参数，遇到格式不对的参数返回 false
+static bool appendArgs(std::string &out, const char *p, const char *end)
+{
+    while (p < end)
+    {
+        uint8_t type = static_cast<uint8_t>(*p++);
+        char tmp[32];
+        int n = 0;
+        if (type == BinaryLog::kString)
+        {
+            uint32_t len;
+            if (end - p < static_cast<ptrdiff_t>(sizeof(len)))
+            {
+                return false;
+            }
+            memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if (static_cast<size_t>(end - p) < len)
+            {
+                return false;
+            }
+            out.append(p, len);
+            p += len;
+            continue;
+        }
+
+        uint64_t raw;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(raw)))
+        {
+            return false;
+        }
+        memcpy(&raw, p, sizeof(raw));
+        p += sizeof(raw);
+        switch (type)
+        {
+        case BinaryLog::kInt:
+            n = snprintf(tmp, sizeof(tmp), "%" PRId64, static_cast<int64_t>(raw));
+            break;
+        case BinaryLog::kUint:
+            n = snprintf(tmp, sizeof(tmp), "%" PRIu64, raw);
+            break;
+        case BinaryLog::kDouble:
+        {
+            double d;
+            memcpy(&d, &raw, sizeof(d));
+            n = snprintf(tmp, sizeof(tmp), "%g", d);
+            break;
+        }
+        case BinaryLog::kPointer:
+            n = snprintf(tmp, sizeof(tmp), "%p", reinterpret_cast<void *>(static_cast<uintptr_t>(raw)));
+            break;
+        default:
+            return false;
+        }
+        out.append(tmp, n);
+    }
+    return true;
+}
+
+// 解码一个文件，返回是否完整解码
+static bool decode(const char *path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+    {
+        fprintf(stderr, "open %s failed\n", path);
+        return false;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::unordered_map<uint32_t, Site> sites; // 当前进程登记的调用点，遇到开始记录时清空
+    std::string line;
+    size_t pos = 0;
+    while (pos + sizeof(BinaryLog::RecordHeader) <= data.size())
+    {
+        const char *rec = data.data() + pos;
+        BinaryLog::RecordHeader header;
+        memcpy(&header, rec, sizeof(header));
+        if (header.size < sizeof(header) || header.size > data.size() - pos)
+        {
+            // 最后一条记录可能还没写完（日志线程正在写，或者进程崩溃时只写了一半）
+            fprintf(stderr, "%s: bad or truncated record at offset %zu\n", path, pos);
+            return false;
+        }
+        pos += header.size;
+
+        if (header.tag == BinaryLog::kStartTag && header.size >= sizeof(BinaryLog::StartRecord))
+        {
+            BinaryLog::StartRecord start;
+            memcpy(&start, rec, sizeof(start));
+            if (memcmp(start.magic, BinaryLog::kMagic, sizeof(start.magic)) != 0)
+            {
+                fprintf(stderr, "%s: bad magic at offset %zu\n", path, pos - header.size);
+                return false;
+            }
+            sites.clear(); // 新的进程，调用点编号重新算起
+        }
+        else if (header.tag == BinaryLog::kSiteTag && header.size >= sizeof(BinaryLog::SiteRecord))
+        {
+            BinaryLog::SiteRecord def;
+            memcpy(&def, rec, sizeof(def));
+            if (sizeof(def) + def.filelen + def.funclen > header.size)
+            {
+                fprintf(stderr, "%s: bad site record at offset %zu\n", path, pos - header.size);
+                return false;
+            }
+            const char *name = rec + sizeof(def);
+            sites[def.id] = Site{def.level, def.line, std::string(name, def.filelen),
+                                 std::string(name + def.filelen, def.funclen)};
+        }
+        else if (header.tag == BinaryLog::kDropTag && header.size >= sizeof(BinaryLog::DropRecord))
+        {
+            BinaryLog::DropRecord drop;
+            memcpy(&drop, rec, sizeof(drop));
+            printf("Dropped %" PRIu64 " log messages from %" PRIu64 " threads at %s\n", drop.count, drop.threads,
+                   TimesTamp(static_cast<time_t>(drop.time / 1000000000)).tostring().c_str());
+        }
+        else if (header.tag < BinaryLog::kMaxSiteId && header.size >= sizeof(BinaryLog::EventHeader))
+        {
+            BinaryLog::EventHeader event;
+            memcpy(&event, rec, sizeof(event));
+
+            line.clear();
+            auto it = sites.find(event.site);
+            line += '[';
+            line += it != sites.end() ? Log::level2str(static_cast<Log::Level>(it->second.level)) : "UNKN ";
+            line += "][PID:";
+            line += std::to_string(event.tid);
+            line += "][";
+            appendTime(line, event.time);
+            line += "][";
+            if (it != sites.end())
+            {
+                line += it->second.file;
+                line += ':';
+                line += std::to_string(it->second.line);
+                line += "][";
+                line += it->second.func;
+            }
+            else // 调用点定义丢失，只能给出编号
+            {
+                line += "site ";
+                line += std::to_string(event.site);
+                line += "][?";
+            }
+            line += "] ";
+            if (!appendArgs(line, rec + sizeof(event), rec + header.size))
+            {
+                line += "<bad argument>";
+            }
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        else
+        {
+            fprintf(stderr, "%s: unknown record tag %#x at offset %zu\n", path, header.tag, pos - header.size);
+        }
+    }
+    if (pos != data.size())
+    {
+        fprintf(stderr, "%s: truncated record at offset %zu\n", path, pos);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s logfile...\n", argv[0]);
+        return -1;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!decode(argv[i]))
+        {
+            ret = 1;
+        }
+    }
+    return ret;
+}
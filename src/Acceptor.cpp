@@ -49,8 +49,8 @@ void Acceptor::onconnect()
         int clientFd = m_psocket->accept4(clientaddr); // 从内核的Accept队列里面取出已经完成三次握手的连接
         if (clientFd != -1)
         {
-            // 使用智能指针管理客户端通信的套接字对象
-            auto pClientSocket = std::make_shared<Socket>(clientFd, clientaddr);
+            // 使用智能指针管理客户端通信的套接字对象，从本事件循环的内存池分配
+            auto pClientSocket = std::allocate_shared<Socket>(PoolAllocator<Socket>(m_ploop->objectpool()), clientFd, clientaddr);
 
             if (pClientSocket->setnodelayopt() == -1)
             {
@@ -1,32 +1,74 @@
 #include "AsyncLogging.h"
+#include "BinaryLog.h"
+#include "Log.h"
 #include "TimesTamp.h"
 #include <fstream>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
 
-bool AsyncLogging::exist = false;
+std::atomic<bool> AsyncLogging::exist(false);
+
+LogRing::LogRing()
+    : data(new char[kCapacity]),
+      tid(syscall(SYS_gettid))
+{
+}
+
+// 写入一条日志，空间不够时丢弃整条日志并计数
+bool LogRing::push(const char *logData, size_t len)
+{
+    uint64_t w = writeIndex.load(std::memory_order_relaxed);
+    uint64_t r = readIndex.load(std::memory_order_acquire); // 日志线程取走数据之后，这部分空间才能复用
+    if (kCapacity - (w - r) < len)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // 日志可能跨过环的末尾，分两段拷贝
+    size_t pos = w & (kCapacity - 1);
+    size_t first = std::min(len, kCapacity - pos);
+    memcpy(data.get() + pos, logData, first);
+    memcpy(data.get(), logData + first, len - first);
+
+    writeIndex.store(w + len, std::memory_order_release); // 数据拷贝完成之后才对日志线程可见
+    return true;
+}
+
+// 已经写入、还没被日志线程取走的字节数
+size_t LogRing::size() const
+{
+    return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_relaxed);
+}
 
 AsyncLogging::AsyncLogging(uint32_t flushInterval)
-    : m_output(&std::cerr),
+    : m_stderr(STDERR_FILENO),
       m_flushInterval(flushInterval),
-      m_currentBuffer(new LogBuffer),
-      m_nextBuffer(new LogBuffer),
+      m_output(&std::cerr),
+      m_dropped(0),
       m_running(false),
-      m_thread([this](){
-        this->ThreadFunc();
-      })
+      m_wakeup(false)
 {
-    m_nextBuffer->reset();
-    m_buffers.reserve(16); // 避免后端线程在 频繁 push_back 时触发 vector 重新分配和拷贝
+    m_rings.reserve(16);
+    exist.store(true);
 }
 
-AsyncLogging::~AsyncLogging() 
+AsyncLogging::~AsyncLogging()
 {
+    exist.store(false); // 之后的日志改为同步输出，不再访问本对象
+
     if (m_running)
     {
         stop();
     }
+    else
+    {
+        drain(); // 没有启动过日志线程，把已经缓存的日志输出
+    }
 
     // 判断 m_output 是不是文件输出流
-    std::ofstream* file = dynamic_cast<std::ofstream*>(m_output);
+    std::ofstream* file = dynamic_cast<std::ofstream*>(m_output.load());
     if (file)
     {
         file->close();
@@ -35,149 +77,253 @@ AsyncLogging::~AsyncLogging()
 
 void AsyncLogging::start() // 启动异步日志
 {
-    m_running.store(true);
+    if (m_running.exchange(true))
+    {
+        return;
+    }
+
+    // 日志线程在这里才创建，保证它看到 m_running 为 true
+    m_thread = std::thread([this]()
+                           { this->ThreadFunc(); });
 }
 
 void AsyncLogging::stop() // 关闭异步日志
 {
-    m_running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_running.store(false);
+    }
     m_cond.notify_one();
-    m_thread.join();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
 }
 
-void AsyncLogging::Append(const char *logData, uint32_t len)
+// 获取当前线程的环形缓冲区，线程第一次写日志时创建并登记
+LogRing *AsyncLogging::localRing()
 {
-    /////////////////////////////锁区域/////////////////////////////////////////
+    // 线程退出时把缓冲区标记为已关闭，日志线程取完剩余的日志后删除。
+    // holder 持有 shared_ptr，即使日志单例先于该线程析构，这里访问的内存仍然有效
+    struct Holder
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        if (m_currentBuffer->available() >= len) // 当前缓冲区可以放下 len 长度的日志
-        {
-            m_currentBuffer->append(logData, len);
-        }
-        else // 当前缓冲区放不下 len 长度的日志
+        std::shared_ptr<LogRing> ring;
+        ~Holder()
         {
-            // 高性能
-            m_buffers.push_back(std::move(m_currentBuffer)); // 将当前缓冲区里的数据移动到缓冲队列里
-
-            if (m_nextBuffer) // 备胎缓冲区可用
-            {
-                m_currentBuffer = std::move(m_nextBuffer); // 夺舍备胎缓冲区
-            }
-            else // 备胎缓冲区已被夺舍，现在不可用。（这种情况很少发生，除非日志写得太快）
+            if (ring)
             {
-                m_currentBuffer.reset(new LogBuffer); // 再生成一块Buffer，此时日志系统的前端就有三个Buffer
+                ring->closed.store(true, std::memory_order_release);
+                ring.reset();
             }
+        }
+    };
+    static thread_local Holder t_holder;
 
-            m_currentBuffer->append(logData, len); // 存放日志
-            m_cond.notify_one();                   // 唤醒后端负责日志落盘的线程
+    if (!t_holder.ring)
+    {
+        auto ring = std::make_shared<LogRing>();
+        {
+            std::lock_guard<std::mutex> lock(m_ringsmtx); // 每个线程只登记一次
+            m_rings.push_back(ring);
         }
+        t_holder.ring = std::move(ring);
     }
-    /////////////////////////////锁区域/////////////////////////////////////////
+    return t_holder.ring.get();
 }
 
-// 处理日志的落盘任务，由单独的日志线程来执行
-void AsyncLogging::ThreadFunc()
+void AsyncLogging::Append(const char *logData, uint32_t len)
 {
-    std::vector<BufferPtr> buffersToWrite; // 用来替换 m_buffer
-    buffersToWrite.reserve(16);
-
-    BufferPtr newBuffer1(new LogBuffer);
-    BufferPtr newBuffer2(new LogBuffer);
-
-    while (m_running || m_currentBuffer->cur > 0)
+    LogRing *ring = localRing();
+    if (!ring->push(logData, len))
     {
-        /////////////////////////////锁区域/////////////////////////////////////////
-        {
-            std::unique_lock<std::mutex> lock(m_mtx);
-
-            if (m_buffers.empty()) // 如果前端缓存队列为空，则睡眠 flushInterval 秒
-            {
-                m_cond.wait_for(lock, std::chrono::seconds(m_flushInterval));
-            }
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
 
-            // 醒来之后，发现m_currentBuffer所指的空间 以及 前端缓冲队列都是空的，则continue
-            if(m_buffers.empty() && m_currentBuffer->cur == 0)
-            {
-                continue;
-            }
+    // 缓冲区用掉一半时唤醒日志线程，不等刷新间隔到期。每个刷新周期最多唤醒一次，
+    // 不持有锁通知，写日志的线程不会阻塞在日志线程的锁上。偶尔错过一次通知时，m_wakeup 保持为 true，
+    // 日志线程最迟在刷新间隔到期时醒来，另一半空间足够缓冲这段时间的日志
+    if (ring->size() >= LogRing::kCapacity / 2 && !m_wakeup.load(std::memory_order_relaxed) &&
+        !m_wakeup.exchange(true, std::memory_order_relaxed))
+    {
+        m_cond.notify_one();
+    }
+}
 
-            // 线程超时醒来后，或者被其他线程唤醒。此时日志线程已经拿到锁，其他的线程在这个期间无法写日志。
-            m_buffers.push_back(std::move(m_currentBuffer)); // 将当前缓冲区m_currentBuffer里的内容添加到缓冲队列m_buffers里
-            m_currentBuffer = std::move(newBuffer1); // 用 newBuffer1 缓冲区替换 m_currentBuffer，保证日志系统的前端不会停
+// 把所有环形缓冲区里的日志写到日志文件或者 m_output，返回是否写出了数据
+bool AsyncLogging::drain()
+{
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::shared_ptr<LogFile> file;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsmtx);
+        rings = m_rings;
+        file = m_file;
+    }
 
-            buffersToWrite.swap(m_buffers); // 交换日志系统前后端的缓冲队列，同样是为了保证日志系统的前端不会停
+    std::vector<uint64_t> ends(rings.size()); // 每个环形缓冲区这一轮取到的位置，写出之后才把空间还给所属线程
+    std::vector<bool> closed(rings.size());
+    m_iov.clear();
+    uint64_t dropped = 0;   // 这一轮报告的丢弃条数
+    size_t droppers = 0;    // 丢弃过日志的线程数
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        LogRing *ring = rings[i].get();
+        // 先读关闭标记再读写下标：标记为关闭之后所属线程不会再写，取完这一次就可以删除
+        closed[i] = ring->closed.load(std::memory_order_acquire);
+        uint64_t r = ring->readIndex.load(std::memory_order_relaxed);
+        uint64_t w = ring->writeIndex.load(std::memory_order_acquire);
+        ends[i] = w;
 
-            if (!m_nextBuffer) // 如果当前缓冲区的备胎已经被夺舍，需要给它恢复，以便下次可以继续被夺舍
+        if (w != r)
+        {
+            // 直接引用环形缓冲区里的数据，跨过环末尾的部分分成两段，不拷贝到中间缓冲区
+            size_t len = w - r;
+            size_t pos = r & (LogRing::kCapacity - 1);
+            size_t first = std::min(len, LogRing::kCapacity - pos);
+            m_iov.push_back({ring->data.get() + pos, first});
+            if (len > first)
             {
-                m_nextBuffer = std::move(newBuffer2);
+                m_iov.push_back({ring->data.get(), len - first});
             }
         }
-        /////////////////////////////锁区域/////////////////////////////////////////
 
-        if (buffersToWrite.size() > 25) // 如果日志系统后端的缓冲队列 bufferToWrite 里面日志块的数量大于25，则丢弃多余的日志块，只剩下两块。
+        uint64_t n = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (n > 0)
         {
-            char msg[256] = {0};
-            snprintf(msg, sizeof(msg), "Dropped log messages at %s, %zd larger buffers\n",
-                    TimesTamp::now().tostring().data(), buffersToWrite.size()-2);
-
-            // 将msg落盘到日志里面
-            ////////////////////
-            *m_output << msg;
-            m_output->flush();
-            fputs(msg, stderr);
-            
-            buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end()); // 只留下最前面的两块
+            dropped += n;
+            ++droppers;
         }
+    }
 
-        // 将后端的缓冲队列里的内容全部落盘
-        for (const auto& e : buffersToWrite)
+    bool binary = Log::GetOutputFormat() == Log::BINARY;
+    if (binary)
+    {
+        // 这一轮取到的日志用到的调用点都已经登记过了（登记在写入日志之前），把还没写出过的定义放在它们前面
+        m_binsites.clear();
+        m_siteswritten = BinaryLog::appendSites(m_binsites, m_siteswritten);
+        if (!m_binsites.empty())
         {
-            ////////////////////
-            *m_output << e->data;
-            m_output->flush();
+            m_iov.insert(m_iov.begin(), {&m_binsites[0], m_binsites.size()});
         }
+    }
 
-
-        if (buffersToWrite.size() > 2)
+    char msg[256];
+    if (dropped > 0) // 明确报告丢弃了多少条日志，不默默丢失。每一轮汇总成一条，不刷屏
+    {
+        int n = snprintf(msg, sizeof(msg), "Dropped %llu log messages from %zu threads at %s\n",
+                         static_cast<unsigned long long>(dropped), droppers, TimesTamp::now().tostring().data());
+        if (binary) // 二进制文件里不能混入文本，用一条记录报告
+        {
+            m_bindrop.clear();
+            BinaryLog::appendDrop(m_bindrop, dropped, droppers);
+            m_iov.push_back({&m_bindrop[0], m_bindrop.size()});
+        }
+        else
+        {
+            m_iov.push_back({msg, static_cast<size_t>(n)});
+        }
+        time_t now = time(nullptr);
+        if ((file || m_output.load() != &std::cerr) && now != m_lastdropreport) // 日志不在控制台时，每秒最多在标准错误上提示一次
         {
-            buffersToWrite.resize(2); // 清除多余的数据，只剩下两个后续给newBuffer1 和 newBuffer2 赋值。
+            fputs(msg, stderr);
+            m_lastdropreport = now;
         }
+    }
 
-        // 如果 newBuffer1 所指的空间已经和 m_currentBuffer 交换，需要将newBuffer1重新赋值。
-        if (!newBuffer1)
+    bool wrote = !m_iov.empty();
+    if (wrote)
+    {
+        std::ostream *output = m_output.load();
+        if (file || output == &std::cerr)
         {
-            newBuffer1 = std::move(buffersToWrite.back());
-            buffersToWrite.pop_back();
-            newBuffer1->reset(); // 将 LogBuffer 格式化
+            // 所有线程的日志一次 writev 写到文件描述符
+            (file ? file.get() : &m_stderr)->append(m_iov.data(), static_cast<int>(m_iov.size()));
         }
+        else
+        {
+            for (const auto &iov : m_iov)
+            {
+                output->write(static_cast<const char *>(iov.iov_base), iov.iov_len);
+            }
+            output->flush();
+        }
+    }
 
-        // 如果 newBuffer2 所指的空间已经和 m_nextBuffer 交换，需要将newBuffer2重新赋值。
-        if (!newBuffer2)
+    for (size_t i = 0; i < rings.size(); ++i)
+    {
+        rings[i]->readIndex.store(ends[i], std::memory_order_release); // 写出之后才把空间还给所属线程
+        if (closed[i])
         {
-            newBuffer2 = std::move(buffersToWrite.back());
-            buffersToWrite.pop_back();
-            newBuffer2->reset();
+            std::lock_guard<std::mutex> lock(m_ringsmtx);
+            m_rings.erase(std::remove(m_rings.begin(), m_rings.end(), rings[i]), m_rings.end());
         }
+    }
+    return wrote;
+}
+
+// 处理日志的落盘任务，由单独的日志线程来执行
+void AsyncLogging::ThreadFunc()
+{
+    while (m_running.load())
+    {
+        drain();
 
-        buffersToWrite.clear();
+        // 睡眠 flushInterval 秒，或者直到某个线程的缓冲区用掉一半、或者关闭日志
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cond.wait_for(lock, std::chrono::seconds(m_flushInterval), [this]()
+                        { return !m_running.load() || m_wakeup.load(std::memory_order_relaxed); });
+        m_wakeup.store(false, std::memory_order_relaxed);
     }
+
+    drain(); // 关闭之前把剩余的日志全部落盘
 }
 
 void AsyncLogging::setOutput(std::ostream* os)
 {
-    m_output = os;
+    // 每条日志都会调用，只在输出位置改变时才写，避免所有线程反复写同一个缓存行
+    if (m_output.load(std::memory_order_relaxed) != os)
+    {
+        m_output.store(os);
+    }
 }
 
-// 获取 AsyncLogging 类的单例
-AsyncLogging* AsyncLogging::getInstance(uint32_t flushInterval)
+// 日志写到以 basename 命名的文件，按大小和日期滚动
+bool AsyncLogging::setLogFile(const std::string& basename, size_t rollSize, int fsyncInterval)
 {
-    if (!exist)
+    std::shared_ptr<LogFile> file;
+    if (!basename.empty())
     {
-        exist = true;
+        file = std::make_shared<LogFile>(basename, rollSize, fsyncInterval);
+        if (!file->isopen())
+        {
+            return false;
+        }
+        file->setheader([]()
+                        {
+                            // 二进制格式下每个文件以开始记录和全部调用点定义开头
+                            std::string header;
+                            if (Log::GetOutputFormat() == Log::BINARY)
+                            {
+                                BinaryLog::appendStart(header);
+                                BinaryLog::appendSites(header, 0);
+                            }
+                            return header; });
     }
 
-    static AsyncLogging asyncLog(flushInterval);
-    return &asyncLog;
+    std::lock_guard<std::mutex> lock(m_ringsmtx); // 原来的文件由日志线程用完这一轮之后关闭
+    m_file = std::move(file);
+    return true;
 }
 
+// 启动以来因为缓冲区满而丢弃的日志条数
+uint64_t AsyncLogging::droppedCount() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
 
+// 获取 AsyncLogging 类的单例
+AsyncLogging* AsyncLogging::getInstance(uint32_t flushInterval)
+{
+    static AsyncLogging asyncLog(flushInterval);
+    return &asyncLog;
+}
@@ -0,0 +1,107 @@
+#include "BinaryLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+constexpr char BinaryLog::kMagic[8];
+
+namespace
+{
+    // 调用点登记表，下标加1就是调用点编号。调用点对象都是静态的，登记表只保存指针
+    struct SiteRegistry
+    {
+        std::mutex mtx;
+        std::vector<const LogSite *> sites;
+    };
+
+    // 函数内的静态对象，静态初始化阶段写日志也能安全使用
+    SiteRegistry &registry()
+    {
+        static SiteRegistry r;
+        return r;
+    }
+
+    int64_t nowNanos()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+}
+
+// 登记调用点并分配编号
+uint32_t BinaryLog::registerSite(const LogSite &site)
+{
+    SiteRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    uint32_t id = site.id.load(std::memory_order_relaxed);
+    if (id == 0) // 多个线程同时第一次执行同一条语句时只登记一次
+    {
+        r.sites.push_back(&site);
+        id = static_cast<uint32_t>(r.sites.size());
+        site.id.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+// 已经登记的调用点个数
+size_t BinaryLog::siteCount()
+{
+    SiteRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    return r.sites.size();
+}
+
+// 把开始记录追加到 out
+void BinaryLog::appendStart(std::string &out)
+{
+    StartRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.size = sizeof(rec);
+    rec.tag = kStartTag;
+    memcpy(rec.magic, kMagic, sizeof(kMagic));
+    rec.pid = getpid();
+    out.append(reinterpret_cast<const char *>(&rec), sizeof(rec));
+}
+
+// 把编号大于 from 的调用点定义追加到 out
+size_t BinaryLog::appendSites(std::string &out, size_t from)
+{
+    SiteRegistry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    for (size_t i = from; i < r.sites.size(); ++i)
+    {
+        const LogSite *site = r.sites[i];
+        size_t filelen = std::min<size_t>(strlen(site->file), UINT16_MAX);
+        size_t funclen = std::min<size_t>(strlen(site->func), UINT16_MAX);
+
+        SiteRecord rec;
+        rec.size = static_cast<uint32_t>(sizeof(rec) + filelen + funclen);
+        rec.tag = kSiteTag;
+        rec.id = static_cast<uint32_t>(i + 1);
+        rec.level = site->level;
+        rec.line = site->line;
+        rec.filelen = static_cast<uint16_t>(filelen);
+        rec.funclen = static_cast<uint16_t>(funclen);
+        out.append(reinterpret_cast<const char *>(&rec), sizeof(rec));
+        out.append(site->file, filelen);
+        out.append(site->func, funclen);
+    }
+    return std::max(from, r.sites.size());
+}
+
+// 把丢弃日志的报告追加到 out
+void BinaryLog::appendDrop(std::string &out, uint64_t count, uint64_t threads)
+{
+    DropRecord rec;
+    rec.size = sizeof(rec);
+    rec.tag = kDropTag;
+    rec.count = count;
+    rec.threads = threads;
+    rec.time = nowNanos();
+    out.append(reinterpret_cast<const char *>(&rec), sizeof(rec));
+}
@@ -4,14 +4,44 @@
 #include <errno.h>
 #include <cstring>
 #include <arpa/inet.h> 
+#include <algorithm>
 Buffer::Buffer(size_t initialSize)
     : m_buffer(initialSize + kCheapPrepend),
       m_readerIndex(kCheapPrepend),
-      m_writerIndex(kCheapPrepend)
+      m_writerIndex(kCheapPrepend),
+      m_readhint(initialSize)
 {
     assert(initialSize > 0);
 }
 
+// 接管other的底层内存，不拷贝数据，other变为空缓冲区
+Buffer::Buffer(Buffer&& other) noexcept
+    : m_buffer(std::move(other.m_buffer)),
+      m_readerIndex(other.m_readerIndex),
+      m_writerIndex(other.m_writerIndex),
+      m_readhint(other.m_readhint)
+{
+    other.m_buffer = std::vector<char>(kCheapPrepend); // 保留前缀区域，other 之后仍然可以正常使用
+    other.m_readerIndex = kCheapPrepend;
+    other.m_writerIndex = kCheapPrepend;
+}
+
+// 接管other的底层内存，不拷贝数据，other变为空缓冲区
+Buffer& Buffer::operator=(Buffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        m_buffer = std::move(other.m_buffer);
+        m_readerIndex = other.m_readerIndex;
+        m_writerIndex = other.m_writerIndex;
+        m_readhint = other.m_readhint;
+        other.m_buffer = std::vector<char>(kCheapPrepend);
+        other.m_readerIndex = kCheapPrepend;
+        other.m_writerIndex = kCheapPrepend;
+    }
+    return *this;
+}
+
 
 // 获取当前可读的数据量
 size_t Buffer::readableBytes() const
@@ -114,6 +144,14 @@ void Buffer::append(const void* data, size_t len)
     append(static_cast<const char*>(data), len);
 }
 
+// 将长度为len的data插到可读数据之前，占用前缀区域，用来在消息体写好之后再填消息头
+void Buffer::prepend(const void* data, size_t len)
+{
+    assert(len <= prependableBytes());
+    m_readerIndex -= len;
+    memcpy(begin() + m_readerIndex, data, len);
+}
+
 // 确保缓冲区里能写下len长度的数据
 void Buffer::ensureWriteableBytes(size_t len)
 {
@@ -151,10 +189,15 @@ void Buffer::makeSpace(size_t len)
     }
 } 
 
-// 从内核缓冲区读取数据
-size_t Buffer::readFd(int fd, int* savedError) 
+// 从内核缓冲区读取数据，放不下的部分先读到 extrabuf 里
+size_t Buffer::readFd(int fd, int* savedError, char* extrabuf, size_t extralen)
 {
-    char extrabuf[65536] = {0}; //64KB，处于栈上
+    // 按照最近的读取量预留可写空间，让大部分数据直接读进缓冲区，不需要再从溢出区拷贝
+    if (writableBytes() < m_readhint)
+    {
+        ensureWriteableBytes(m_readhint);
+    }
+
     struct iovec vec[2];
     size_t writable = writableBytes();
 
@@ -162,18 +205,20 @@ size_t Buffer::readFd(int fd, int* savedError)
     vec[0].iov_base = beginWrite();
     vec[0].iov_len = writable;
 
-    // 存放内核读缓冲区数据的 区域2
+    // 存放内核读缓冲区数据的 区域2，由调用者提供，不需要清零
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof(extrabuf);
+    vec[1].iov_len = extralen;
 
-    // 如果缓冲区当前可写的空间发现小于64KB，则启动区域2来辅助接收数据
-    const int iovcnt = writable < sizeof(extrabuf) ? 2 : 1;
+    // 如果缓冲区当前可写的空间小于溢出区，则启动区域2来辅助接收数据
+    const int iovcnt = writable < extralen ? 2 : 1;
     const ssize_t n = readv(fd, vec, iovcnt);
     if (n == -1)
     {
         *savedError = errno;
+        return n;
     }
-    else if (n < writable)
+
+    if (n < writable)
     {
         m_writerIndex += n;
     }
@@ -183,5 +228,30 @@ size_t Buffer::readFd(int fd, int* savedError)
         append(extrabuf, n-writable); // 将区域2中的数据添加到buffer缓冲区
     }
 
+    // 更新预估的读取量：缓冲区被读满说明预估偏小，翻倍增长；否则慢慢向实际读取量回落
+    if (static_cast<size_t>(n) >= writable)
+    {
+        m_readhint = std::min(std::max(m_readhint * 2, static_cast<size_t>(n)), kMaxReadHint);
+    }
+    else
+    {
+        m_readhint = std::max<size_t>((m_readhint * 7 + n) / 8, kMinReadHint);
+    }
+
     return n;
 }
+
+// 没有可读数据时，把底层内存和预估的读取量缩回初始大小。突发的大流量让缓冲区扩容之后不会再自己缩小，
+// 由事件循环对空闲的连接调用，大量空闲连接不会各自占着扩容到的内存
+void Buffer::shrink()
+{
+    if (readableBytes() != 0 || m_buffer.size() <= kInitialSize + kCheapPrepend)
+    {
+        return;
+    }
+
+    std::vector<char>(kInitialSize + kCheapPrepend).swap(m_buffer); // 释放原来的内存
+    m_readerIndex = kCheapPrepend;
+    m_writerIndex = kCheapPrepend;
+    m_readhint = std::min(m_readhint, kInitialSize);
+}
@@ -0,0 +1,467 @@
+#include "ChainBuffer.h"
+
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <unistd.h>
+#include <climits>
+#include <algorithm>
+#include <errno.h>
+
+FileRegion::~FileRegion()
+{
+    ::close(fd);
+}
+
+// 未发送数据的首地址，文件数据段没有
+const char* ChainBuffer::Segment::peek() const
+{
+    if (auto pbuf = std::get_if<Buffer>(&data))
+    {
+        return pbuf->peek();
+    }
+    if (auto pstr = std::get_if<std::string>(&data))
+    {
+        return pstr->data() + offset;
+    }
+    return std::get<SharedBlock>(data)->data() + offset;
+}
+
+// 未发送的数据量
+size_t ChainBuffer::Segment::size() const
+{
+    if (auto pbuf = std::get_if<Buffer>(&data))
+    {
+        return pbuf->readableBytes();
+    }
+    if (auto pstr = std::get_if<std::string>(&data))
+    {
+        return pstr->size() - offset;
+    }
+    if (auto pfile = std::get_if<SharedFile>(&data))
+    {
+        return (*pfile)->length - offset;
+    }
+    return std::get<SharedBlock>(data)->size() - offset;
+}
+
+// 消费len长度的数据
+void ChainBuffer::Segment::retrieve(size_t len)
+{
+    if (auto pbuf = std::get_if<Buffer>(&data))
+    {
+        pbuf->retrieve(len);
+    }
+    else
+    {
+        offset += len;
+    }
+}
+
+// 是否为文件数据段
+bool ChainBuffer::Segment::isfile() const
+{
+    return std::holds_alternative<SharedFile>(data);
+}
+
+// 获取待发送的数据量
+size_t ChainBuffer::readableBytes() const
+{
+    return m_bytes;
+}
+
+// 是否没有待发送的数据
+bool ChainBuffer::empty() const
+{
+    return m_bytes == 0;
+}
+
+// 拷贝长度为len的data到队尾
+void ChainBuffer::append(const char* data, size_t len)
+{
+    if (len == 0)
+    {
+        return;
+    }
+
+    // 队尾是Buffer段就直接追加（包括保留下来的空Buffer段），否则新建一个Buffer段。
+    // 零拷贝发送过的、正在异步发送的Buffer段不能再追加，扩容会释放内核还在引用的内存
+    if (m_head == m_segments.size() || !std::holds_alternative<Buffer>(m_segments.back().data) || m_segments.back().zerocopied ||
+        m_segments.size() - m_head <= m_sendingsegs)
+    {
+        size_t initialSize = len > Buffer::kInitialSize ? len : Buffer::kInitialSize;
+        m_segments.push_back(Segment{Buffer(initialSize)});
+    }
+
+    std::get<Buffer>(m_segments.back().data).append(data, len);
+    m_bytes += len;
+}
+
+// 接管字符串，作为一个数据段排队
+void ChainBuffer::append(std::string&& str)
+{
+    if (str.size() < kCopyThreshold) // 很小的字符串直接拷贝，和相邻的小数据合并成一个数据段
+    {
+        append(str.data(), str.size());
+        return;
+    }
+
+    m_bytes += str.size();
+    m_segments.push_back(Segment{std::move(str)});
+}
+
+// 共享只读数据块，作为一个数据段排队
+void ChainBuffer::append(std::shared_ptr<const std::string> block)
+{
+    if (!block || block->empty())
+    {
+        return;
+    }
+
+    m_bytes += block->size();
+    m_segments.push_back(Segment{std::move(block)});
+}
+
+// 接管Buffer里的可读数据，作为一个数据段排队
+void ChainBuffer::append(Buffer&& buf)
+{
+    if (buf.readableBytes() < kCopyThreshold)
+    {
+        append(buf.peek(), buf.readableBytes());
+        buf.retrieveAll();
+        return;
+    }
+
+    m_bytes += buf.readableBytes();
+    m_segments.push_back(Segment{std::move(buf)});
+}
+
+// 文件区域作为一个数据段排队
+void ChainBuffer::append(std::shared_ptr<FileRegion> file)
+{
+    if (!file || file->length == 0)
+    {
+        return;
+    }
+
+    m_bytes += file->length;
+    m_segments.push_back(Segment{std::move(file)});
+}
+
+// 用队首的内存数据段填充 iovec，遇到文件数据段为止，返回填充的个数
+int ChainBuffer::peekiov(struct iovec* iov, int maxcnt) const
+{
+    int cnt = 0;
+    for (size_t i = m_head; i < m_segments.size() && cnt < maxcnt; ++i)
+    {
+        if (m_segments[i].size() == 0) // 保留下来的空Buffer段
+        {
+            continue;
+        }
+        if (m_segments[i].isfile()) // 文件数据段要等前面的内存数据发完，再单独用 sendfile 发送
+        {
+            break;
+        }
+        iov[cnt].iov_base = const_cast<char*>(m_segments[i].peek());
+        iov[cnt].iov_len = m_segments[i].size();
+        ++cnt;
+    }
+    return cnt;
+}
+
+// 消费len长度的数据
+void ChainBuffer::retrieve(size_t len)
+{
+    while (len > 0 && m_head < m_segments.size())
+    {
+        Segment& seg = m_segments[m_head];
+        size_t n = std::min(len, seg.size());
+        seg.retrieve(n);
+        m_bytes -= n;
+        len -= n;
+
+        if (seg.size() == 0)
+        {
+            // 最后一个数据段是Buffer时保留下来，之后的小数据继续拷贝进去，避免每次发送都重新分配内存
+            if (m_head + 1 == m_segments.size() && std::holds_alternative<Buffer>(seg.data) && !seg.zerocopied)
+            {
+                break;
+            }
+            popfront();
+        }
+    }
+}
+
+// 消费所有数据
+void ChainBuffer::retrieveAll()
+{
+    for (size_t i = m_head; i < m_segments.size(); ++i)
+    {
+        if (m_segments[i].zerocopied)
+        {
+            pin(std::move(m_segments[i]));
+        }
+    }
+    m_segments.clear();
+    m_head = 0;
+    m_bytes = 0;
+}
+
+// 把数据发送到内核缓冲区，返回发送的字节数。队首是文件数据段时用 sendfile 发送，否则聚合发送连续的内存数据段
+ssize_t ChainBuffer::writeFd(int fd, int* savedError)
+{
+    // 跳过保留下来的空Buffer段，找到第一个有数据的数据段
+    size_t first = m_head;
+    while (first < m_segments.size() && m_segments[first].size() == 0)
+    {
+        ++first;
+    }
+    if (first < m_segments.size() && m_segments[first].isfile())
+    {
+        return sendfilehead(fd, m_segments[first], savedError);
+    }
+
+    struct iovec iov[IOV_MAX];
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = peekiov(iov, IOV_MAX);
+
+    size_t total = 0;
+    for (size_t i = 0; i < msg.msg_iovlen; ++i)
+    {
+        total += iov[i].iov_len;
+    }
+
+    // 用 sendmsg 代替 writev，才能加上 MSG_NOSIGNAL：对端已关闭(RST)时，内核不会给进程发送SIGPIPE信号。
+    // 这次发不完队列里的数据（超过 IOV_MAX 个数据段，或者后面还有文件数据段）时加上 MSG_MORE，
+    // 内核先不把最后一个不满的报文段发出去，和紧接着的下一次发送合并，效果同 TCP_CORK
+    int flags = MSG_NOSIGNAL;
+    if (total < m_bytes)
+    {
+        flags |= MSG_MORE;
+    }
+    bool zerocopy = m_zerocopythreshold > 0 && total >= m_zerocopythreshold;
+
+    ssize_t n = ::sendmsg(fd, &msg, flags | (zerocopy ? MSG_ZEROCOPY : 0));
+    if (n == -1 && zerocopy && errno == ENOBUFS) // 超过了内核给零拷贝预留的内存，这次改为普通发送
+    {
+        zerocopy = false;
+        n = ::sendmsg(fd, &msg, flags);
+    }
+
+    if (n > 0)
+    {
+        if (zerocopy)
+        {
+            markzerocopy(n, m_zcnext++);
+        }
+        retrieve(n);
+    }
+    else if (n == -1)
+    {
+        *savedError = errno;
+    }
+    return n;
+}
+
+// 用队首的内存数据段填好异步发送的 msghdr，队首是文件数据段或者没有数据时返回 nullptr
+const struct msghdr* ChainBuffer::beginsend(int* flags)
+{
+    size_t first = m_head;
+    while (first < m_segments.size() && m_segments[first].size() == 0)
+    {
+        ++first;
+    }
+    if (first == m_segments.size() || m_segments[first].isfile())
+    {
+        return nullptr;
+    }
+
+    m_sendiov.resize(std::min<size_t>(m_segments.size() - first, IOV_MAX));
+    int cnt = peekiov(m_sendiov.data(), static_cast<int>(m_sendiov.size()));
+    size_t total = 0;
+    for (int i = 0; i < cnt; ++i)
+    {
+        total += m_sendiov[i].iov_len;
+    }
+
+    // 已经排队的数据段全部封住，不只是这次发送的：数据段的数据地址不会变（vector 扩容时移动的是 Buffer 和长字符串，
+    // 底层内存不动），只要不往这些数据段里追加、不释放它们，请求引用的内存就一直有效
+    m_sendingsegs = m_segments.size() - m_head;
+
+    m_sendmsg = {};
+    m_sendmsg.msg_iov = m_sendiov.data();
+    m_sendmsg.msg_iovlen = cnt;
+    *flags = MSG_NOSIGNAL | (total < m_bytes ? MSG_MORE : 0); // 和 writeFd 一样
+    return &m_sendmsg;
+}
+
+// 异步发送完成，消费发送出去的 len 字节
+void ChainBuffer::endsend(ssize_t len)
+{
+    m_sendingsegs = 0;
+    if (len > 0)
+    {
+        retrieve(len);
+    }
+}
+
+// 是否有还没完成的异步发送
+bool ChainBuffer::sending() const
+{
+    return m_sendingsegs > 0;
+}
+
+// 移除队首已经发送完的数据段
+void ChainBuffer::popfront()
+{
+    if (m_segments[m_head].zerocopied) // 内核可能还引用着这块内存，等完成通知之后再释放
+    {
+        pin(std::move(m_segments[m_head]));
+    }
+    m_segments[m_head].data.emplace<std::string>(); // 立即释放已经发送完的数据
+    ++m_head;
+    if (m_head == m_segments.size()) // 全部发送完，复用 vector 的内存
+    {
+        m_segments.clear();
+        m_head = 0;
+    }
+    else if (m_head >= 16 && m_head * 2 >= m_segments.size()) // 已发送的数据段占了一半以上，整体前移
+    {
+        m_segments.erase(m_segments.begin(), m_segments.begin() + m_head);
+        m_head = 0;
+    }
+}
+
+// 用 sendfile 发送队首的文件数据段，文件内容由内核直接拷贝到套接字，不经过用户态内存
+ssize_t ChainBuffer::sendfilehead(int fd, const Segment& seg, int* savedError)
+{
+    const FileRegion& file = *std::get<SharedFile>(seg.data);
+    off_t offset = file.offset + static_cast<off_t>(seg.offset);
+    size_t count = std::min<size_t>(seg.size(), 0x7ffff000); // sendfile 单次最多发送 0x7ffff000 字节
+
+    ssize_t n = ::sendfile(fd, file.fd, &offset, count);
+    if (n > 0)
+    {
+        retrieve(n);
+    }
+    else if (n == 0) // 文件在发送过程中被截短，剩下的数据永远发不出去
+    {
+        *savedError = EIO;
+        return -1;
+    }
+    else
+    {
+        *savedError = errno;
+    }
+    return n;
+}
+
+// 设置零拷贝发送的阈值，0表示不启用
+void ChainBuffer::setzerocopy(size_t threshold)
+{
+    m_zerocopythreshold = threshold;
+}
+
+// 长度为len的数据是否要用零拷贝发送
+bool ChainBuffer::iszerocopy(size_t len) const
+{
+    return m_zerocopythreshold > 0 && len >= m_zerocopythreshold;
+}
+
+// 内核通知编号在 [lo, hi] 之间的零拷贝发送已经完成，释放不再被内核引用的数据段
+// TCP 套接字的完成通知按编号顺序到达，每次的 lo 都紧接着上一次的 hi，所以只需要用 hi 推进，lo 不用
+void ChainBuffer::releasezerocopy(uint32_t /* lo */, uint32_t hi)
+{
+    // 编号是32位的循环计数，用差值比较先后
+    if (static_cast<int32_t>(hi + 1 - m_zcdone) > 0)
+    {
+        m_zcdone = hi + 1;
+    }
+
+    while (!m_pinned.empty() && static_cast<int32_t>(m_pinned.front().zcid - m_zcdone) < 0)
+    {
+        m_pinned.pop_front();
+    }
+}
+
+// 读空套接字 fd 错误队列里的零拷贝完成通知，释放已经完成的数据段
+void ChainBuffer::reapzerocopy(int fd)
+{
+    while (true)
+    {
+        char control[128];
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) // 错误队列读空（EAGAIN），或者是真正的套接字错误，交给读写流程处理
+        {
+            break;
+        }
+
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+
+            auto* serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            {
+                // ee_info 到 ee_data 是这次通知覆盖的发送编号范围。
+                // SO_EE_CODE_ZEROCOPY_COPIED 表示内核实际上还是拷贝了（例如回环地址），同样可以释放
+                releasezerocopy(serr->ee_info, serr->ee_data);
+            }
+        }
+    }
+}
+
+// 丢弃还没发送的数据，把内核可能还引用着的数据段连同发送编号一起转移出来。
+// 零拷贝发送过的数据段即使已经交给内核，也可能还要用来重传，连接关闭之后也要等完成通知再释放
+ChainBuffer ChainBuffer::detachpinned()
+{
+    retrieveAll(); // 零拷贝发送过、还没发完的数据段也放进 m_pinned
+
+    ChainBuffer pinned;
+    pinned.m_pinned.swap(m_pinned);
+    pinned.m_zcnext = m_zcnext;
+    pinned.m_zcdone = m_zcdone;
+    return pinned;
+}
+
+// 已经发送完、但还在等待零拷贝完成通知的数据段个数
+size_t ChainBuffer::pinnedSegments() const
+{
+    return m_pinned.size();
+}
+
+// 把队首len字节所在的数据段标记为被编号为id的零拷贝发送引用
+void ChainBuffer::markzerocopy(size_t len, uint32_t id)
+{
+    for (size_t i = m_head; i < m_segments.size() && len > 0; ++i)
+    {
+        Segment& seg = m_segments[i];
+        size_t n = std::min(len, seg.size());
+        if (n == 0)
+        {
+            continue;
+        }
+        seg.zerocopied = true;
+        seg.zcid = id;
+        len -= n;
+    }
+}
+
+// 发送完的数据段等零拷贝完成通知之后再释放
+void ChainBuffer::pin(Segment&& seg)
+{
+    if (static_cast<int32_t>(seg.zcid - m_zcdone) < 0) // 已经完成的发送不需要再保留
+    {
+        return;
+    }
+    m_pinned.push_back(std::move(seg));
+}
@@ -35,9 +35,9 @@ int Channel::getfd() const
 }
 
 // 设置 m_isinepoll 成员
-void Channel::setisinepoll()
+void Channel::setisinepoll(bool inepoll)
 {
-    m_isinepoll = true;
+    m_isinepoll = inepoll;
 }
 
 // 返回 m_isinepoll 成员
@@ -58,6 +58,18 @@ uint32_t Channel::getevents() const
     return m_events;
 }
 
+// 设置 m_regevents 成员，由 Poller 在注册成功之后调用
+void Channel::setregevents(uint32_t ev)
+{
+    m_regevents = ev;
+}
+
+// 返回 m_regevents 成员
+uint32_t Channel::getregevents() const
+{
+    return m_regevents;
+}
+
 // 设置 happenevents 成员
 void Channel::sethappenevents(uint32_t ev)
 {
@@ -111,16 +123,46 @@ void Channel::disableall()
     m_pelp->updateChannel(this);
 }
 
-// 从事件循环中删除Channel
+// 从事件循环中删除Channel。直接删除，不需要先把监视的事件改成0
 void Channel::remove()
 {
-    disableall();
+    m_events = 0;
     m_pelp->removeChannel(this);
 }
 
+// 提交一个 recv 请求
+void Channel::submitrecv()
+{
+    m_pelp->submitRecv(this);
+}
+
+// 提交一个 sendmsg 请求
+void Channel::submitsendmsg(const struct msghdr* msg, int flags, std::shared_ptr<void> keepalive)
+{
+    m_pelp->submitSendmsg(this, msg, flags, std::move(keepalive));
+}
+
+// 设置 recv 请求的结果
+void Channel::setrecvresult(const char* data, ssize_t res)
+{
+    m_recvdata = data;
+    m_recvres = res;
+}
+
+// 设置 sendmsg 请求的结果
+void Channel::setsendresult(ssize_t res)
+{
+    m_sendres = res;
+}
+
 // 处理 epoll监视到已经发生的事件
 void Channel::handleevents()
 {
+    if ((m_happenevents & EPOLLERR) && m_erroreventcb) // 错误队列里有消息，在关闭连接之前先处理
+    {
+        m_erroreventcb();
+    }
+
     if (m_happenevents & EPOLLRDHUP) // 对端客户端关闭了连接
     {
         std::ostringstream oss;
@@ -143,6 +185,16 @@ void Channel::handleevents()
     {
         m_writeeventcb();
     }
+
+    if ((m_happenevents & kRecvDone) && m_recvdonecb) // 提交的 recv 请求完成
+    {
+        m_recvdonecb(m_recvdata, m_recvres);
+    }
+
+    if ((m_happenevents & kSendDone) && m_senddonecb) // 提交的 sendmsg 请求完成
+    {
+        m_senddonecb(m_sendres);
+    }
 }
 
 // 设置 m_readeventcb
@@ -161,4 +213,22 @@ void Channel::setcloseconnectioncb(const std::function<void()> &func)
 void Channel::setwriteeventcb(const std::function<void()>& func)
 {
     m_writeeventcb = func;
-}
\ No newline at end of file
+}
+
+// 设置 m_erroreventcb
+void Channel::seterroreventcb(const std::function<void()>& func)
+{
+    m_erroreventcb = func;
+}
+
+// 设置 m_recvdonecb
+void Channel::setrecvdonecb(const std::function<void(const char*, ssize_t)>& func)
+{
+    m_recvdonecb = func;
+}
+
+// 设置 m_senddonecb
+void Channel::setsenddonecb(const std::function<void(ssize_t)>& func)
+{
+    m_senddonecb = func;
+}
@@ -2,13 +2,17 @@
 #include "Socket.h"
 #include "Channel.h"
 
+#include <algorithm>
 #include <cstring>
+#include <sys/socket.h>
+#include <fcntl.h>
 
 Connection::Connection(std::shared_ptr<Socket> psocket, EventLoop *ploop)
     : m_psocket(psocket),
       m_ploop(ploop),
-      m_pchannel(std::make_shared<Channel>(ploop, m_psocket)),
-      m_disconnect(false)
+      m_pchannel(std::allocate_shared<Channel>(PoolAllocator<Channel>(ploop->objectpool()), ploop, m_psocket)),
+      m_disconnect(false),
+      m_asyncio(ploop->asyncio())
 {
     // 设置 和通信套接字关联的Channel对象 的读事件回调函数
     m_pchannel->setreadeventcb([this]()
@@ -22,6 +26,16 @@ Connection::Connection(std::shared_ptr<Socket> psocket, EventLoop *ploop)
     m_pchannel->setwriteeventcb([this]()
                                 { this->sendto(); });
 
+    // 设置 和通信套接字关联的Channel对象 的错误事件回调函数，零拷贝发送的完成通知通过错误队列到达
+    m_pchannel->seterroreventcb([this]()
+                                { this->onerror(); });
+
+    // 完成式 I/O 下 recv/sendmsg 请求完成的回调函数
+    m_pchannel->setrecvdonecb([this](const char *data, ssize_t res)
+                              { this->onrecvdone(data, res); });
+    m_pchannel->setsenddonecb([this](ssize_t res)
+                              { this->onsenddone(res); });
+
     // 设置边沿模式
     m_pchannel->setepollet();
 }
@@ -29,7 +43,21 @@ Connection::Connection(std::shared_ptr<Socket> psocket, EventLoop *ploop)
 // 在Connection对象析构的时候，智能指针会自动释放其管理的内存，无需手动delete
 Connection::~Connection()
 {
-    m_pchannel->remove(); // 移除事件循环检测
+    // 连接通常已经在 removeFromLoop 里从事件循环移除了，这里只处理没有经过 deleteConnection 的情况。
+    // 最后一个引用可能在工作线程里释放，Poller（尤其是 io_uring）不能跨线程修改，交给I/O线程移除；
+    // 任务持有 Socket，fd 在移除之前不会被关闭、也就不会被新连接复用
+    if (m_pchannel->getisinepoll())
+    {
+        if (m_ploop->isEventLoopThread())
+        {
+            m_pchannel->remove();
+        }
+        else
+        {
+            m_ploop->addTask([psocket = m_psocket, pchannel = m_pchannel]()
+                             { pchannel->remove(); });
+        }
+    }
 
     std::ostringstream oss;
     oss << "ip=" << m_psocket->getip()
@@ -54,6 +82,12 @@ int Connection::fd() const
     return m_psocket->fd();
 }
 
+// 获取 Connection 所属的事件循环
+EventLoop* Connection::getloop() const
+{
+    return m_ploop;
+}
+
 // 将Connection连接添加到延迟删除树
 void Connection::closeconnection()
 {
@@ -80,55 +114,92 @@ void Connection::onmessage()
     m_lasttime = TimesTamp::now();
     m_ploop->updateConnection(fd());
 
-    // 一次性将通信套接字的读缓冲区读空
     while (true)
     {
-        int errnum = 0;
-        ssize_t recvLen = m_inputbuf.readFd(m_psocket->fd(), &errnum);
-
-        if (recvLen > 0)
-        {
-            continue;
-        }
-        else if (recvLen == 0) // 对端正常关闭
+        // 一次性将通信套接字的读缓冲区读空，读缓冲区达到上限时先停下来处理
+        bool full = false;
+        bool peerclosed = false; // 对端关闭了写端：先处理收到的数据，回复发完之后再关闭连接
+        while (true)
         {
-            if (0 == m_inputbuf.readableBytes()) // Connection 的缓冲区中没有数据需要处理
-            {
-                closeconnection();
-                return;
-            }
-            else // Connection 的缓冲区中还有数据需要处理
+            int errnum = 0;
+            ssize_t recvLen = m_inputbuf.readFd(m_psocket->fd(), &errnum, m_ploop->scratch(), m_ploop->scratchsize());
+
+            if (recvLen > 0)
             {
-                break;
+                if (inputfull()) // 读缓冲区达到上限，先处理已经收到的数据
+                {
+                    full = true;
+                    break;
+                }
+
+                // 边沿触发且没有注册 EPOLLRDHUP：和数据一起到达的 FIN 不会再触发读事件，
+                // 即使这次没读满也要一直读到 EAGAIN 或者 0，否则会漏掉对端的关闭
+                continue;
             }
-        }
-        else if (recvLen == -1)
-        {
-            if (errnum == EAGAIN || errnum == EWOULDBLOCK) // 缓冲区里以的数据已经读完
+            else if (recvLen == 0) // 对端正常关闭（至少关闭了写端），FIN 不会再触发读事件。写缓冲区里可能还有没发完的回复
             {
+                peerclosed = true;
                 break;
             }
-            else if (errnum == EINTR) // 由于信号中断，打断了recv读取缓冲区数据的过程
-            {
-                continue; // 重新开始读取
-            }
-            else if (errnum == ECONNRESET) // 对端异常关闭
+            else if (recvLen == -1)
             {
-                LOG(warn) << "peer reset, fd=" << fd();
-                closeconnection();
-                return;
-            }
-            else // recv函数确实发生了预期之外的错误, 服务器端主动和发生故障的客户端断开连接
-            {
-                LOG(error) << "recv() err" << errno;
-                closeconnection();
-                return;
+                if (errnum == EAGAIN || errnum == EWOULDBLOCK) // 缓冲区里以的数据已经读完
+                {
+                    break;
+                }
+                else if (errnum == EINTR) // 由于信号中断，打断了recv读取缓冲区数据的过程
+                {
+                    continue; // 重新开始读取
+                }
+                else if (errnum == ECONNRESET) // 对端异常关闭
+                {
+                    LOG(warn) << "peer reset, fd=" << fd();
+                    closeconnection();
+                    return;
+                }
+                else // recv函数确实发生了预期之外的错误, 服务器端主动和发生故障的客户端断开连接
+                {
+                    LOG(error) << "recv() err" << errno;
+                    closeconnection();
+                    return;
+                }
             }
         }
-    }
 
-    // 调用回调函数，处理客户端发送来的每一条数据
-    m_handlemessagecb(shared_from_this(), &m_inputbuf);
+        // 调用回调函数，处理客户端发送来的每一条数据。回调里的 send 只把回复放进写缓冲区，
+        // 本轮事件循环的末尾和其他来源的回复合并成一次 sendmsg 发送
+        if (!peerclosed || m_inputbuf.readableBytes() > 0)
+        {
+            m_handlemessagecb(shared_from_this(), &m_inputbuf);
+        }
+
+        // 对端已经关闭写端，不再读。写缓冲区里的回复、工作线程还没交回来的回复都发完之后再关闭
+        if (peerclosed)
+        {
+            onpeerclosed();
+            return;
+        }
+
+        // 读缓冲区满了还要接着读：先把回复发出去，再根据高水位线决定是否继续读
+        if (full)
+        {
+            flush();
+        }
+
+        // 内核读缓冲区已经读空，或者连接已经关闭，或者写缓冲区积压到高水位线（暂停读，回落到低水位线再继续）
+        if (!full || m_disconnect.load() || m_abovehighwater)
+        {
+            break;
+        }
+
+        // 回调处理之后读缓冲区仍然是满的，说明对端发来的单条消息超过了上限，断开连接
+        if (inputfull())
+        {
+            LOG(warn) << "input buffer exceeds limit " << m_inputlimit << ", fd=" << fd();
+            closeconnection();
+            return;
+        }
+    }
 
     // while (true) // 解析客户端发送过来的每一条数据
     // {
@@ -154,22 +225,242 @@ void Connection::onmessage()
     // }
 }
 
-// 将数据放到Connection对象的写缓冲区里，并注册写事件
-void Connection::send(const std::string &msg)
+// 完成式 I/O 下 recv 请求完成：把数据追加到读缓冲区，处理之后提交下一个 recv 请求
+void Connection::onrecvdone(const char *data, ssize_t res)
 {
-    if (!m_disconnect.load())
+    m_recving = false;
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (res < 0)
     {
-        if (m_ploop->isEventLoopThread()) // 如果执行当前函数的是I/O线程，则直接将数据写到Connection对象的写缓冲区中
+        if (res == -EINTR || res == -EAGAIN)
         {
-            writeTo(msg);
+            enablereading(); // 重新提交
         }
-        else // 如果执行当前函数的是工作线程，则将发送数据的操作交给I/O线程来做。不能在工作线程内发送数据，会和I/O线程产生竞态条件
+        else if (res == -ECONNRESET) // 对端异常关闭
         {
-            // 将发送数据的任务添加到事件循环对象的任务队列中，等待I/O线程来处理任务
-            m_ploop->addTask([this, msg]() // msg在这里是值拷贝
-                             { writeTo(msg); });
+            LOG(warn) << "peer reset, fd=" << fd();
+            closeconnection();
         }
+        else
+        {
+            LOG(error) << "recv() err" << -res;
+            closeconnection();
+        }
+        return;
+    }
+
+    m_lasttime = TimesTamp::now();
+    m_ploop->updateConnection(fd());
+
+    // 数据在 Poller 的接收缓冲区里，下一次等待之前就会被复用，拷贝到连接自己的读缓冲区
+    if (res > 0)
+    {
+        m_inputbuf.append(data, res);
+    }
+    if (res > 0 || m_inputbuf.readableBytes() > 0)
+    {
+        m_handlemessagecb(shared_from_this(), &m_inputbuf);
+    }
+
+    if (res == 0) // 对端关闭了写端
+    {
+        onpeerclosed();
+        return;
+    }
+
+    // 回调处理之后读缓冲区仍然是满的，说明对端发来的单条消息超过了上限，断开连接
+    if (inputfull())
+    {
+        LOG(warn) << "input buffer exceeds limit " << m_inputlimit << ", fd=" << fd();
+        closeconnection();
+        return;
+    }
+
+    if (m_reading && !m_disconnect.load()) // 写缓冲区积压到高水位线时不再提交，回落到低水位线再继续
+    {
+        enablereading();
+    }
+}
+
+// 对端已经关闭写端：不再读，写缓冲区里的回复、工作线程还没交回来的回复都发完之后再关闭
+void Connection::onpeerclosed()
+{
+    m_peerclosed.store(true);
+    disablereading();
+    queueflush();
+    closeifdrained(); // 没有待发送的数据时 flush 什么也不做，这里检查一次
+}
+
+// 开始读：就绪模式下注册读事件，完成模式下提交 recv 请求（已经有一个没完成时什么也不做）
+void Connection::enablereading()
+{
+    if (!m_asyncio)
+    {
+        m_pchannel->enablereading();
+        return;
+    }
+
+    m_reading = true;
+    if (!m_recving)
+    {
+        m_recving = true;
+        m_pchannel->submitrecv();
+    }
+}
+
+// 停止读：就绪模式下取消读事件，完成模式下已经提交的 recv 请求完成之后不再提交
+void Connection::disablereading()
+{
+    if (!m_asyncio)
+    {
+        m_pchannel->disablereading();
+        return;
+    }
+
+    m_reading = false;
+}
+
+// 发送msg，工作线程调用时拷贝一次
+void Connection::send(const std::string &msg)
+{
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread()) // 如果执行当前函数的是I/O线程，则直接写，写不完的部分拷贝到写缓冲区
+    {
+        writeTo(msg.data(), msg.size());
+    }
+    else // 如果执行当前函数的是工作线程，则将发送数据的操作交给I/O线程来做。不能在工作线程内发送数据，会和I/O线程产生竞态条件
+    {
+        send(std::string(msg));
+    }
+}
+
+// 发送msg，接管字符串，不拷贝
+void Connection::send(std::string &&msg)
+{
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        writeTo(std::move(msg));
+    }
+    else
+    {
+        // 任务持有Connection对象，保证I/O线程执行任务时连接还没有被释放；msg移动进任务，再移动到写缓冲区
+        m_queuedsends.fetch_add(1);
+        m_ploop->addTask([self = shared_from_this(), msg = std::move(msg)]() mutable
+                         {
+                             self->writeTo(std::move(msg));
+                             self->m_queuedsends.fetch_sub(1); });
+    }
+}
+
+// 发送长度为len的data，工作线程调用时拷贝一次
+void Connection::send(const void *data, size_t len)
+{
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        writeTo(static_cast<const char *>(data), len);
+    }
+    else // data 的生命周期由调用者管理，交给I/O线程之前只能拷贝一次
+    {
+        send(std::string(static_cast<const char *>(data), len));
+    }
+}
+
+// 发送buf里的可读数据，接管Buffer，不拷贝
+void Connection::send(Buffer &&buf)
+{
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        writeTo(std::move(buf));
+    }
+    else
+    {
+        m_queuedsends.fetch_add(1);
+        m_ploop->addTask([self = shared_from_this(), buf = std::move(buf)]() mutable
+                         {
+                             self->writeTo(std::move(buf));
+                             self->m_queuedsends.fetch_sub(1); });
+    }
+}
+
+// 发送共享的只读数据块，多个连接可以发送同一块数据，不拷贝
+void Connection::send(std::shared_ptr<const std::string> block)
+{
+    if (m_disconnect.load() || !block)
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        writeTo(std::move(block));
+    }
+    else
+    {
+        m_queuedsends.fetch_add(1);
+        m_ploop->addTask([self = shared_from_this(), block = std::move(block)]() mutable
+                         {
+                             self->writeTo(std::move(block));
+                             self->m_queuedsends.fetch_sub(1); });
+    }
+}
+
+// 发送文件 fd 里从 offset 开始、长度为 length 的数据，由写事件驱动 sendfile 发送
+bool Connection::sendFile(int fd, off_t offset, size_t length)
+{
+    if (m_disconnect.load())
+    {
+        return false;
+    }
+    if (length == 0)
+    {
+        return true;
+    }
+
+    // 复制一份 fd 由写缓冲区持有，发送完或者连接释放时关闭，不依赖调用者的 fd 的生命周期
+    int filefd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (filefd == -1)
+    {
+        LOG(error) << "sendFile() dup err, errno=" << errno;
+        return false;
+    }
+    auto file = std::make_shared<FileRegion>(filefd, offset, length);
+
+    if (m_ploop->isEventLoopThread())
+    {
+        writeTo(std::move(file));
     }
+    else
+    {
+        m_queuedsends.fetch_add(1);
+        m_ploop->addTask([self = shared_from_this(), file = std::move(file)]() mutable
+                         {
+                             self->writeTo(std::move(file));
+                             self->m_queuedsends.fetch_sub(1); });
+    }
+    return true;
 }
 
 // 将 Connection 写缓冲区里的数据发送到内核的写缓冲区
@@ -177,16 +468,33 @@ void Connection::sendto()
 {
     if (!m_disconnect.load())
     {
+        if (m_outputbuf.sending()) // 完成模式下还有 sendmsg 请求没完成，完成之后在 onsenddone 里接着发
+        {
+            return;
+        }
+
         while (m_outputbuf.readableBytes() > 0)
         {
-            // 加上 MSG_NOSIGNAL 信号，当对端已关闭(RST)时，内核不会给进程发送SIGPIPE信号，只会有errno = EPIPE 错误码
-            ssize_t writeLen = ::send(fd(), m_outputbuf.peek(), m_outputbuf.readableBytes(), MSG_NOSIGNAL);
+            // 完成模式下内存数据段作为 sendmsg 请求提交，和下一次等待合并成一次系统调用；文件数据段仍然同步 sendfile
+            if (m_asyncio && submitsend())
+            {
+                if (m_pchannel->getevents() & EPOLLOUT)
+                {
+                    m_pchannel->disablewriting();
+                }
+                return;
+            }
+
+            // 把写缓冲区里的多个数据段一次聚合发送，内部加上了 MSG_NOSIGNAL，当对端已关闭(RST)时只会有errno = EPIPE 错误码
+            int errnum = 0;
+            ssize_t writeLen = m_outputbuf.writeFd(fd(), &errnum);
             if (writeLen > 0)
             {
-                m_outputbuf.retrieve(writeLen);
+                continue;
             }
             else
             {
+                errno = errnum;
                 if (errno == EAGAIN || errno == EWOULDBLOCK) // 内核的发送缓冲区已满
                 {
                     break;
@@ -207,26 +515,329 @@ void Connection::sendto()
             }
         }
 
-        // m_outputbuf里面所有的数据都发送完，则停止监听读事件
+        // 积压的数据发送到低水位线以下，恢复读
+        checklowwatermark();
+
+        // m_outputbuf里面所有的数据都发送完，则停止监听写事件；没发完则注册写事件，等内核发送缓冲区有空间再发
         if (0 == m_outputbuf.readableBytes())
         {
-            m_pchannel->disablewriting();
+            if (m_pchannel->getevents() & EPOLLOUT)
+            {
+                m_pchannel->disablewriting();
+            }
             m_sendcompletecb(shared_from_this());
+            closeifdrained();
+        }
+        else if (!m_disconnect.load() && !(m_pchannel->getevents() & EPOLLOUT))
+        {
+            m_pchannel->enablewriting();
         }
     }
 }
 
-// 将Connection对象的Channel 添加到事件循环中，让epoll监听它的读事件
+// 完成模式下把写缓冲区队首的内存数据段作为 sendmsg 请求提交，队首是文件数据段时返回 false
+bool Connection::submitsend()
+{
+    int flags = 0;
+    const struct msghdr *msg = m_outputbuf.beginsend(&flags);
+    if (msg == nullptr)
+    {
+        return false;
+    }
+
+    // 请求持有连接：连接关闭之后，写缓冲区也要等请求完成（或者被取消）才能释放
+    m_pchannel->submitsendmsg(msg, flags, shared_from_this());
+    return true;
+}
+
+// 完成式 I/O 下 sendmsg 请求完成：消费发送出去的数据，接着发送剩下的数据
+void Connection::onsenddone(ssize_t res)
+{
+    m_outputbuf.endsend(res);
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    if (res < 0)
+    {
+        if (res == -EPIPE || res == -ECONNRESET)
+        {
+            LOG(warn) << "peer closed, fd=" << fd();
+        }
+        else
+        {
+            LOG(error) << "sendmsg() fatal, errno=" << -res;
+        }
+        closeconnection();
+        return;
+    }
+
+    // 全部发完时和同步发送一样：恢复读、调用 m_sendcompletecb、检查半关闭的连接是否可以关闭
+    sendto();
+}
+
+// 将Connection对象的Channel从事件循环中移除
+void Connection::removeFromLoop()
+{
+    if (m_pchannel->getisinepoll())
+    {
+        m_pchannel->remove(); // 完成模式下还没完成的 recv/sendmsg 请求会被取消
+    }
+
+    // sendmsg 请求还没完成时它持有着连接，写缓冲区留到请求完成、连接析构时再释放
+    if (m_outputbuf.sending())
+    {
+        return;
+    }
+
+    // 内核可能还引用着零拷贝发送过的数据段（例如还要重传），连同套接字一起交给事件循环，等完成通知到达之后再释放
+    ChainBuffer pinned = m_outputbuf.detachpinned();
+    if (pinned.pinnedSegments() > 0)
+    {
+        m_ploop->lingerZerocopy(m_psocket, std::move(pinned));
+    }
+}
+
+// 将Connection对象的Channel 添加到事件循环中，让epoll监听它的读事件；完成模式下提交第一个 recv 请求
 void Connection::addToEpoll()
 {
-    m_pchannel->enablereading();
+    enablereading();
+}
+
+// 把连接加入事件循环的待发送列表，本轮事件循环的末尾统一发送，同一轮里多次 send 只发送一次
+void Connection::queueflush()
+{
+    if (m_flushqueued || m_disconnect.load())
+    {
+        return;
+    }
+
+    m_flushqueued = true;
+    m_ploop->queueFlush(shared_from_this());
+}
+
+// 把写缓冲区里排队的数据一次聚合发送，发不完注册写事件，并检查高水位线
+void Connection::flush()
+{
+    m_flushqueued = false;
+    if (m_disconnect.load())
+    {
+        return;
+    }
+
+    // 已经注册了写事件说明内核发送缓冲区是满的，等写事件再发，不做一次注定 EAGAIN 的系统调用
+    if (!m_outputbuf.empty() && !(m_pchannel->getevents() & EPOLLOUT))
+    {
+        sendto();
+    }
+    checkhighwatermark();
+}
+
+// 将长度为len的data写入Connection对象的写缓冲区
+void Connection::writeTo(const char *data, size_t len)
+{
+    m_outputbuf.append(data, len);
+    queueflush();
+}
+
+// 将待发送的数据msg作为一个数据段放入Connection对象的写缓冲区，不拷贝
+void Connection::writeTo(std::string &&msg)
+{
+    m_outputbuf.append(std::move(msg));
+    queueflush();
+}
+
+// 将buf作为一个数据段放入Connection对象的写缓冲区，不拷贝
+void Connection::writeTo(Buffer &&buf)
+{
+    m_outputbuf.append(std::move(buf));
+    queueflush();
+}
+
+// 将共享的只读数据块作为一个数据段放入Connection对象的写缓冲区，不拷贝
+void Connection::writeTo(std::shared_ptr<const std::string> block)
+{
+    m_outputbuf.append(std::move(block));
+    queueflush();
+}
+
+// 开启零拷贝发送，threshold 为0表示关闭
+bool Connection::setzerocopy(size_t threshold)
+{
+    // 完成模式下没有监视 EPOLLERR，收不到错误队列里的完成通知，不支持零拷贝发送
+    if (threshold > 0 && m_asyncio)
+    {
+        return false;
+    }
+
+    // 没有设置 SO_ZEROCOPY 时内核会忽略 MSG_ZEROCOPY，也不会产生完成通知，发送的编号就对不上了
+    if (threshold > 0 && m_psocket->setzerocopyopt() == -1)
+    {
+        return false;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        m_outputbuf.setzerocopy(threshold);
+    }
+    else
+    {
+        m_ploop->addTask([self = shared_from_this(), threshold]()
+                         { self->m_outputbuf.setzerocopy(threshold); });
+    }
+    return true;
+}
+
+// 处理套接字错误队列里的消息，释放零拷贝发送完成的数据段
+void Connection::onerror()
+{
+    m_outputbuf.reapzerocopy(fd());
+}
+
+// 将文件区域作为一个数据段放入Connection对象的写缓冲区
+void Connection::writeTo(std::shared_ptr<FileRegion> file)
+{
+    m_outputbuf.append(std::move(file));
+    queueflush();
+}
+
+// 写缓冲区积压到高水位线时暂停读，并通知上层。只在 flush 里调用，回调在本轮事件循环末尾的 flushPendingOutput 里执行，
+// 不在 send 里重入上层；回调里再 send 的数据会重新加入待发送列表，仍在本轮发送
+void Connection::checkhighwatermark()
+{
+    if (m_highwatermark == 0 || m_abovehighwater || m_disconnect.load() || m_outputbuf.readableBytes() < m_highwatermark)
+    {
+        return;
+    }
+
+    m_abovehighwater = true;
+    disablereading();
+
+    if (m_highwatermarkcb)
+    {
+        m_highwatermarkcb(shared_from_this(), m_outputbuf.readableBytes());
+    }
+}
+
+// 写缓冲区回落到低水位线时恢复读，并通知上层。重新注册读事件时，内核读缓冲区里已有的数据会立即触发读事件
+void Connection::checklowwatermark()
+{
+    if (!m_abovehighwater || m_disconnect.load() ||
+        (m_highwatermark > 0 && m_outputbuf.readableBytes() > m_lowwatermark))
+    {
+        return;
+    }
+
+    m_abovehighwater = false;
+    if (!m_peerclosed.load())
+    {
+        enablereading();
+    }
+
+    if (m_lowwatermarkcb)
+    {
+        m_lowwatermarkcb(shared_from_this(), m_outputbuf.readableBytes());
+    }
+}
+
+// 对端关闭写端之后，回复都发完、没有工作线程的回复在路上时关闭连接，只能在I/O线程中调用
+void Connection::closeifdrained()
+{
+    // 先看工作线程的计数，再看任务队列里的 send：工作线程先 send 再 endreply，计数归零时它的 send 至少已经入队
+    if (!m_peerclosed.load() || m_disconnect.load() || m_pendingreplies.load() > 0 || m_queuedsends.load() > 0 ||
+        !m_outputbuf.empty())
+    {
+        return;
+    }
+    closeconnection();
 }
 
-// 将待发送的数据msg写入Connection对象的写缓冲区
-void Connection::writeTo(const std::string &msg)
+// 有一批消息交给工作线程处理，回复之前对端关闭写端也不关闭连接
+void Connection::beginreply()
 {
-    m_outputbuf.append(msg.data(), msg.size());
-    m_pchannel->enablewriting(); // 注册写事件
+    m_pendingreplies.fetch_add(1);
+}
+
+// 工作线程处理完一批消息，回复都已经 send
+void Connection::endreply()
+{
+    // 先减计数再读 m_peerclosed，I/O线程先写 m_peerclosed 再读计数（都是顺序一致的原子操作）：
+    // 两边至少有一边能看到对方的修改，不会两边都不关闭
+    if (m_pendingreplies.fetch_sub(1) == 1 && m_peerclosed.load())
+    {
+        // 回复的 send 任务先入队，检查排在它们后面，执行时回复已经在写缓冲区里了
+        m_ploop->addTask([self = shared_from_this()]()
+                         { self->closeifdrained(); });
+    }
+}
+
+// 读缓冲区是否达到上限
+bool Connection::inputfull() const
+{
+    return m_inputlimit > 0 && m_inputbuf.readableBytes() >= m_inputlimit;
+}
+
+// 设置写缓冲区的高、低水位线，可以在任意线程调用
+void Connection::setwatermark(size_t high, size_t low)
+{
+    auto apply = [self = shared_from_this(), high, low]()
+    {
+        self->m_highwatermark = high;
+        self->m_lowwatermark = std::min(low, high);
+        self->checklowwatermark(); // 调高或者关闭水位线之后，可能需要立即恢复读
+        if (!self->m_outputbuf.empty())
+        {
+            self->queueflush(); // 调低水位线之后由 flush 检查高水位线，回调同样在本轮事件循环的末尾执行
+        }
+    };
+
+    if (m_ploop->isEventLoopThread())
+    {
+        apply();
+    }
+    else
+    {
+        m_ploop->addTask(std::move(apply));
+    }
+}
+
+// 设置读缓冲区的上限，可以在任意线程调用
+void Connection::setinputlimit(size_t limit)
+{
+    if (m_ploop->isEventLoopThread())
+    {
+        m_inputlimit = limit;
+    }
+    else
+    {
+        m_ploop->addTask([self = shared_from_this(), limit]()
+                         { self->m_inputlimit = limit; });
+    }
+}
+
+// 设置 m_highwatermarkcb
+void Connection::sethighwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func)
+{
+    m_highwatermarkcb = std::move(func);
+}
+
+// 设置 m_lowwatermarkcb
+void Connection::setlowwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func)
+{
+    m_lowwatermarkcb = std::move(func);
+}
+
+// 连接已经空闲 interval 秒以上时释放读缓冲区扩容占用的内存，返回连接是否空闲
+bool Connection::shrinkIfIdle(time_t interval)
+{
+    if (time(nullptr) - m_lasttime.toint() < interval)
+    {
+        return false;
+    }
+
+    m_inputbuf.shrink();
+    return true;
 }
 
 // 判断当前连接是否超时
@@ -1,11 +1,13 @@
 #include "Epoll.h"
+#include "Channel.h"
 
 #include <unistd.h>
 #include <cstring>
 #include <errno.h>
 
 Epoll::Epoll()
-    : m_epfd(epoll_create(1)) 
+    : m_epfd(epoll_create(1)),
+      m_evs(kInitEvents)
     {
         if (m_epfd == -1)
         {
@@ -20,6 +22,13 @@ Epoll::~Epoll()
 
 int Epoll::updatechannel(Channel *pchannel)
 {
+    // 监视的事件和已经注册的相同，不需要调用epoll_ctl。
+    // 例如写缓冲区反复在 空 和 非空 之间切换时，只有真正需要等待写事件时才会修改注册的事件
+    if (pchannel->getisinepoll() && pchannel->getregevents() == pchannel->getevents())
+    {
+        return 0;
+    }
+
     struct epoll_event ev;
     ev.data.ptr = pchannel;
     ev.events = pchannel->getevents();
@@ -32,32 +41,48 @@ int Epoll::updatechannel(Channel *pchannel)
         if (ret == -1)  
         {
             LOG(error) << "epoll_ctl(EPOLL_CTL_MOD) err";
+            return ret;
         }
     }
     else
     {
-        pchannel->setisinepoll();
         ret = epoll_ctl(m_epfd, EPOLL_CTL_ADD, pchannel->getfd(), &ev);
         if (ret == -1)
         {
             LOG(error) << "epoll_ctl(EPOLL_CTL_ADD) err";
+            return ret;
         }
+        pchannel->setisinepoll();
     }
 
+    pchannel->setregevents(ev.events); // 注册成功之后才记录，失败时下次还会重试
     return ret;
 }
 
 // 将通信套接字从epoll中移除
 int Epoll::removechannel(Channel* pchannel)
 {
+    if (!pchannel->getisinepoll())
+    {
+        return 0;
+    }
+
     int ret = epoll_ctl(m_epfd, EPOLL_CTL_DEL, pchannel->getfd(), nullptr);
     if (ret == -1)
     {
         LOG(error) << "epoll_ctl(EPOLL_CTL_DEL) err";
     }
+    pchannel->setisinepoll(false);
+    pchannel->setregevents(0);
     return ret;
 }
 
+// 等待事件发生，即 epollwait
+EpollEvents Epoll::poll(int& timeout)
+{
+    return epollwait(timeout);
+}
+
 // 返回m_epfd
 int Epoll::get() const
 {
@@ -68,37 +93,34 @@ int Epoll::get() const
  * @brief 等待epoll所监听的事件的发生,设置超时时间
  *
  * @param timeout 超时时间，传入传出参数。若传出值为-1，说明发生了错误，若传出值为0，说明没有发生错误。
- * @return vector<struct epoll_event> 若为空，说明发生了错误或者超时时间到，需要结合timeout的传出值来区分。
+ * @return EpollEvents 就绪事件的视图，事件的 data.ptr 指向对应的Channel。若为空，说明发生了错误或者超时时间到，需要结合timeout的传出值来区分。
  */
-vector<Channel*> Epoll::epollwait(int& timeout)
+EpollEvents Epoll::epollwait(int& timeout)
 {
-    vector<Channel*> retvec;
-    memset((void *)&m_evs, 0, MAXEVENTS);
-    int cnt = epoll_wait(m_epfd, m_evs, MAXEVENTS, timeout);
+    // 上一轮事件数组被填满，说明还有就绪事件没取出来，扩容后让本轮一次取出更多的事件。
+    // 扩容放在 epoll_wait 之前进行，保证上一轮返回的视图在使用期间不会失效
+    if (m_lastcnt == static_cast<int>(m_evs.size()) && m_evs.size() < kMaxEvents)
+    {
+        m_evs.resize(m_evs.size() * 2);
+    }
+
+    int cnt = epoll_wait(m_epfd, m_evs.data(), static_cast<int>(m_evs.size()), timeout);
     if (cnt == -1) // 出错
     {
+        m_lastcnt = 0;
         if (errno != EINTR)
         {
             timeout = -1;
             LOG(error) << "epoll_wait() err";
         }
-        return retvec;
-    }
-    else if (cnt == 0) // 超时
-    {
-        timeout = 0;
-        return retvec;
-    }
-    else
-    {
-        timeout = 0;
-        retvec.reserve(cnt);
-        for (int i = 0; i < cnt; ++i)
+        else // 被信号中断，当作没有事件发生
         {
-            Channel* channel = static_cast<Channel*>(m_evs[i].data.ptr);
-            channel->sethappenevents(m_evs[i].events);
-            retvec.push_back(channel);
+            timeout = 0;
         }
-        return retvec;
+        return EpollEvents();
     }
+
+    timeout = 0; // 超时或者有事件发生
+    m_lastcnt = cnt;
+    return EpollEvents(m_evs.data(), cnt);
 }
\ No newline at end of file
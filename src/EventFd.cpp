@@ -17,7 +17,7 @@ int EventFd::fd() const
 // 唤醒事件循环
 void EventFd::wakeup()
 {
-    uint64_t val;
+    uint64_t val = 1; // 写入0不会让eventfd变为可读
     write(m_eventfd, &val, 8); // 向m_wakeupfd 里面写入数据，会唤醒epoll_wait
 }
 
@@ -1,15 +1,22 @@
 #include "EventLoop.h"
+#include "Channel.h"
 
 #include <atomic>
+#include <algorithm>
 
-EventLoop::EventLoop(bool ismainpool)
-    : m_pep(std::make_unique<Epoll>()), // 创建epoll
-      m_stop(false),                    // 事件循环停止表示为false
+EventLoop::EventLoop(bool ismainpool, PollerType type)
+    : m_ppoller(Poller::create(type)), // 创建 I/O 多路复用后端
+      m_stop(false),                   // 事件循环停止表示为false
+      m_threadid(0),                   // 事件循环开始运行后才记录所在线程的ID
       m_ismmainloop(ismainpool),
+      m_polling(false),
       m_eventfd(), // 创建 eventfd
       m_pwakechannel(std::make_unique<Channel>(this, std::make_shared<Socket>(m_eventfd.fd()))),
-      m_timer(), // 定时器对象，使用Timer类默认的闹钟时间
-      m_ptimerchannel(std::make_unique<Channel>(this, std::make_shared<Socket>(m_timer.fd())))
+      m_timerqueue(this), // 创建定时器队列
+      m_idletimeout(-1),
+      m_busypollus(0),
+      m_objectpool(std::make_shared<ObjectPool>()),
+      m_connectioncount(0)
 {
     // 设置 事件循环检测到 eventfd 可读之后的回调函数
     m_pwakechannel->setreadeventcb([this]()
@@ -18,12 +25,12 @@ EventLoop::EventLoop(bool ismainpool)
     // 将 eventfd 加入到epoll的事件循环检测中
     m_pwakechannel->enablereading();
 
-    // 设置 事件循环检测到定时器超时 之后的回调函数
-    m_ptimerchannel->setreadeventcb([this]()
-                                    { handleTimer(); });
-
-    // 让事件循环检测定时器的读事件
-    m_ptimerchannel->enablereading();
+    // 从事件循环定期淘汰超时的连接
+    if (!m_ismmainloop)
+    {
+        runEvery(m_evictinterval, [this]()
+                 { handleTimer(); });
+    }
 }
 
 EventLoop::~EventLoop()
@@ -34,40 +41,94 @@ EventLoop::~EventLoop()
 void EventLoop::loop()
 {
     m_threadid = syscall(SYS_gettid); // 获取事件循环所在线程的线层ID
+    m_objectpool->bindthread();       // 内存池的本地链表只由I/O线程访问
+
+    // 接收溢出区在I/O线程里分配，由I/O线程首次访问，不在主线程里预先清零
+    if (!m_scratch)
+    {
+        m_scratch.reset(new char[kScratchSize]);
+    }
 
     while (!m_stop.load())
     {
-        int timeout = 10; // 超时时间10ms
-        vector<Channel *> channels = m_pep->epollwait(timeout);
-        int fdCnt = channels.size();
+        // 先声明即将阻塞，再检查任务队列。和 addTask 里先入队、再检查 m_polling 的顺序配合，
+        // 保证新任务要么在这里被看到，要么入队的线程会通过eventfd唤醒epoll_wait
+        m_polling.store(true);
+        bool hastask = !m_taskqueue.empty();
+
+        // 定时器和任务队列都通过fd唤醒epoll_wait，只有空闲超时需要epoll_wait自己计时
+        int timeout = hastask ? 0 : pollTimeout();
+        bool idlewait = !hastask && timeout >= 0; // 本轮是否在等待空闲超时
+        EpollEvents events = poll(timeout);
+        m_polling.store(false, std::memory_order_relaxed);
+
+        if (timeout == -1) // 出错
+        {
+            return;
+        }
 
-        if (fdCnt == 0) // 出错或者超时
+        if (!events.empty())
         {
-            if (errno == EINTR) // 信号中断
-            {
-                continue;
-            }
-            else if (timeout == 0) // 超时
-            {
-                m_handletimeout(this);
-                continue;
-            }
-            else if (timeout == -1) // 出错
+            // 直接在 epoll 的事件数组上分发事件
+            for (const auto &ev : events)
             {
-                return;
+                Channel *pchannel = static_cast<Channel *>(ev.data.ptr);
+                pchannel->sethappenevents(ev.events);
+                pchannel->handleevents();
             }
         }
-        else if (fdCnt > 0)
+        else if (idlewait && m_handletimeout) // 超时
+        {
+            m_handletimeout(this);
+        }
+
+        // 执行工作线程交给I/O线程的任务
+        doPendingTasks();
+
+        // 把这一轮里所有连接排队的回复发出去，每个连接一次 sendmsg
+        flushPendingOutput();
+
+        // 最后处理需要断开的连接，包括发送时出错、或者回复发完之后关闭的连接，不留到下一次 epoll_wait 之后
+        deleteConnection();
+    }
+}
+
+// 计算本轮epoll_wait的超时时间
+int EventLoop::pollTimeout() const
+{
+    // 定时器(timerfd)和任务队列(eventfd)到期时会让epoll_wait返回，不需要在这里计时；
+    // 只有启用了空闲超时，才需要在超时时间到达时醒来调用 m_handletimeout
+    return m_idletimeout.load(std::memory_order_relaxed);
+}
+
+// 等待事件发生，开启忙轮询时先自旋再阻塞
+EpollEvents EventLoop::poll(int &timeout)
+{
+    int64_t budget = m_busypollus.load(std::memory_order_relaxed);
+    if (budget > 0 && timeout != 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::microseconds(budget);
+        do
         {
-            for (int i = 0; i < fdCnt; ++i)
+            int spintimeout = 0;
+            EpollEvents events = m_ppoller->poll(spintimeout);
+            if (!events.empty() || spintimeout == -1) // 有事件发生或者出错
             {
-                channels[i]->handleevents();
+                timeout = spintimeout;
+                return events;
             }
+        } while (std::chrono::steady_clock::now() < deadline && !m_stop.load(std::memory_order_relaxed));
 
-            // 在每一轮事件循环结束后，再处理需要断开的连接
-            deleteConnection();
+        // 自旋的时间也算在空闲超时里
+        if (timeout > 0)
+        {
+            auto spinms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            timeout = std::max<int>(0, timeout - static_cast<int>(spinms));
         }
     }
+
+    return m_ppoller->poll(timeout);
 }
 
 // 停止事件循环
@@ -83,16 +144,46 @@ void EventLoop::sethandletimeout(std::function<void(EventLoop *)> func)
     m_handletimeout = func;
 }
 
+// 设置空闲超时时间（毫秒），小于0表示不启用
+void EventLoop::setidletimeout(int ms)
+{
+    m_idletimeout.store(ms);
+}
+
+// 设置忙轮询预算，0表示不启用
+void EventLoop::setbusypoll(std::chrono::microseconds budget)
+{
+    m_busypollus.store(budget.count());
+}
+
 // 将Channel添加到事件循环，或者修改Channel在事件循环上面的事件
 void EventLoop::updateChannel(Channel *pchannel)
 {
-    m_pep->updatechannel(pchannel);
+    m_ppoller->updatechannel(pchannel);
 }
 
 // 将Channel从事件循环中删除
 void EventLoop::removeChannel(Channel *pchannel)
 {
-    m_pep->removechannel(pchannel);
+    m_ppoller->removechannel(pchannel);
+}
+
+// I/O 多路复用后端是否支持完成式 I/O
+bool EventLoop::asyncio() const
+{
+    return m_ppoller->asyncio();
+}
+
+// 为Channel提交一个 recv 请求
+void EventLoop::submitRecv(Channel *pchannel)
+{
+    m_ppoller->submitrecv(pchannel);
+}
+
+// 为Channel提交一个 sendmsg 请求
+void EventLoop::submitSendmsg(Channel *pchannel, const struct msghdr *msg, int flags, std::shared_ptr<void> keepalive)
+{
+    m_ppoller->submitsendmsg(pchannel, msg, flags, std::move(keepalive));
 }
 
 // 判断当前线程是不是I/O线程，m_threadid里记录的是每个I/O线程的线程号
@@ -104,108 +195,149 @@ bool EventLoop::isEventLoopThread()
 // 将任务加入到任务队列中
 void EventLoop::addTask(std::function<void()> func)
 {
+    // 入队前队列为空，并且事件循环正阻塞在epoll_wait上，才需要唤醒。
+    // 队列不为空时，之前入队的线程已经唤醒过事件循环，或者事件循环在阻塞前会看到这些任务
+    if (m_taskqueue.push(std::move(func)) && m_polling.load())
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        m_taskqueue.push(func); // 工作线程执行
+        m_eventfd.wakeup(); // 唤醒事件循环
     }
-
-    m_eventfd.wakeup(); // 唤醒事件循环
 }
 
-// 回调函数，处理 eventfd 唤醒epoll_wait
+// 回调函数，处理 eventfd 唤醒epoll_wait。任务统一在每轮事件循环的末尾执行，这里只需要读空eventfd
 void EventLoop::handleWakeUp()
 {
     m_eventfd.wait();
+}
 
-    if (!m_ismmainloop) // 从事件循环在任务队列中取出send任务
-    {
-        // 从任务队列里面取出任务执行，这是在I/O线程中进行的
-        std::lock_guard<std::mutex> lock(m_mtx);
-        while (!m_taskqueue.empty())
-        {
-            std::function<void()> func = std::move(m_taskqueue.front()); // I/O线程执行
-            func();
-            m_taskqueue.pop();
-        }
-    }
+// 取出任务队列里的全部任务并执行，执行期间不持有任何锁，工作线程可以继续入队
+void EventLoop::doPendingTasks()
+{
+    m_taskqueue.consumeall([](std::function<void()> &func)
+                           { func(); }); // I/O线程执行
 }
 
 // 回调函数，处理定时器事件
 void EventLoop::handleTimer()
 {
-    m_timer.wait();
+    removeTimeOutConnection(m_timeout);
+    shrinkIdleConnections(m_evictinterval.count());
+    reapLingering();
+}
 
-    if (!m_ismmainloop) // 从事件循环才处理定时器事件
-    {
-        removeTimeOutConnection(m_timeout);
-    }
+// 在 when 时刻执行 cb
+TimerId EventLoop::runAt(TimerQueue::TimePoint when, std::function<void()> cb)
+{
+    return m_timerqueue.addTimer(when, std::chrono::nanoseconds(0), std::move(cb));
 }
 
-// 有新的连接时，由 TcpServer 调用，往m_lruconnection和m_connectionmap里添加成员
-void EventLoop::newConnection(std::shared_ptr<Connection> pConn)
+// 在 delay 之后执行 cb
+TimerId EventLoop::runAfter(std::chrono::nanoseconds delay, std::function<void()> cb)
 {
-    std::lock_guard<std::mutex> lock(m_mtx);
+    return runAt(std::chrono::steady_clock::now() + delay, std::move(cb));
+}
 
-    // 将新的连接添加到m_lruconnection的头部，shared_ptr可以自动转换成weak_ptr
-    m_lruconnection.push_front(pConn);
+// 每隔 interval 执行一次 cb
+TimerId EventLoop::runEvery(std::chrono::nanoseconds interval, std::function<void()> cb)
+{
+    return m_timerqueue.addTimer(std::chrono::steady_clock::now() + interval, interval, std::move(cb));
+}
 
-    // 在m_connectionmap里记录Connection对象在m_lruconnection里的迭代器位置
-    m_connectionmap[pConn->fd()] = m_lruconnection.begin();
+// 取消定时器
+void EventLoop::cancel(const TimerId &id)
+{
+    m_timerqueue.cancel(id);
 }
 
-// 当Connection连接有I/O事件发生时，由 Connection 调用此函数来“续命”，将Connection连接splice到链表头部
+// 有新的连接时，由 TcpServer 在I/O线程中调用，事件循环持有Connection对象，并把它放到活跃链表的头部
+void EventLoop::newConnection(std::shared_ptr<Connection> pConn)
+{
+    int fd = pConn->fd();
+    if (fd >= static_cast<int>(m_connections.size()))
+    {
+        m_connections.resize(std::max<size_t>(fd + 1, m_connections.size() * 2));
+    }
+
+    ConnectionSlot &slot = m_connections[fd];
+    slot.pconn = std::move(pConn);
+    slot.closing = false;
+    linkfront(fd);
+    m_connectioncount.fetch_add(1, std::memory_order_relaxed);
+}
+
+// 当Connection连接有I/O事件发生时，由 Connection 调用此函数来“续命”，将Connection连接移到活跃链表头部
 void EventLoop::updateConnection(int fd)
 {
-    std::lock_guard<std::mutex> lock(m_mtx);
-    auto it = m_connectionmap.find(fd);
-    if (it != m_connectionmap.end())
+    if (fd < 0 || fd >= static_cast<int>(m_connections.size()) || !m_connections[fd].pconn || m_connections[fd].closing)
+    {
+        return;
+    }
+
+    if (m_lruhead != fd)
     {
-        m_lruconnection.splice(m_lruconnection.begin(), m_lruconnection, it->second);
+        unlink(fd);
+        linkfront(fd);
     }
 }
 
-// 删除超时的连接
+// 把活跃链表尾部超时的连接加入延迟删除列表。不在这里直接释放，本轮epoll_wait返回的事件里可能还有这些连接的Channel
 void EventLoop::removeTimeOutConnection(time_t interval)
 {
-    // 1. 创建一个临时列表，用于存放需要通知 TcpServer 删除的 fd
-    std::vector<int> timeoutfds;
-
+    int fd = m_lrutail;
+    while (fd != -1)
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        // 2. 在一个严格的锁作用域内，安全地遍历和和删除 m_lruconnection里面的超时Connection连接
-        while (!m_lruconnection.empty())
+        ConnectionSlot &slot = m_connections[fd];
+        if (!slot.pconn->isTimeOut(interval)) // 队尾最久没有发生I/O事件的Connection连接都还没超时，那么所有的Connection都没有超时
         {
-            auto connWptr = m_lruconnection.back();
-            if (auto connSptr = connWptr.lock()) // 尝试提升为shared_ptr,如果提升成功，说明该Connection连接没断开
-            {
-                if (connSptr->isTimeOut(interval))
-                {
-                    timeoutfds.push_back(connSptr->fd()); // 收集 fd,稍后从TcpServer持有的Connectionmap里面删除
-                    m_connectionmap.erase(connSptr->fd());
-                    m_lruconnection.pop_back();
-                }
-                else // 队尾最久没有发生I/O事件的Connection连接都还么超时，那么所有的Connection都没有超时
-                {
-                    break;
-                }
-            }
-            else // weak_ptr 提升失败，说明此Connection连接已经被释放
-            {
-                m_lruconnection.pop_back();
-            }
+            break;
         }
+
+        int prev = slot.prev;
+        unlink(fd); // 摘下之后不会再被遍历到，也不会再续命
+        delayDelete(fd);
+        fd = prev;
     }
+}
 
-    for (auto fd : timeoutfds)
+// 从活跃链表尾部开始，释放空闲 interval 秒以上的连接的读缓冲区扩容占用的内存。
+// 链表按最近一次I/O事件排序，遇到第一个不空闲的连接就可以停下；持续收发数据的连接不会被反复缩小、扩大
+void EventLoop::shrinkIdleConnections(time_t interval)
+{
+    for (int fd = m_lrutail; fd != -1; fd = m_connections[fd].prev)
     {
-        m_timerCallback(fd);
+        if (!m_connections[fd].pconn->shrinkIfIdle(interval))
+        {
+            break;
+        }
     }
 }
 
-// 设置m_timerCallback，用来删除TcpServer对象的 map里面的Connection连接
-void EventLoop::settimerCallback(std::function<void(int)> func)
+// 已经关闭的连接还有数据段在等零拷贝完成通知，保留套接字和数据段，直到完成或者超时
+void EventLoop::lingerZerocopy(std::shared_ptr<Socket> psocket, ChainBuffer pinned)
+{
+    // 套接字要保持打开才能收到完成通知，先关闭写端，对端照常收到 FIN
+    psocket->shutdownwrite();
+    m_lingering.push_back(Lingering{std::move(psocket), std::move(pinned), time(nullptr) + m_timeout});
+}
+
+// 读取等待中的套接字的错误队列，释放已经全部完成或者超时的套接字和数据段。
+// 超时说明对端已经很久没有确认数据，不会再重传，这时释放也不会发出错误的数据
+void EventLoop::reapLingering()
 {
-    m_timerCallback = func;
+    time_t now = time(nullptr);
+    for (size_t i = 0; i < m_lingering.size();)
+    {
+        Lingering &l = m_lingering[i];
+        l.pinned.reapzerocopy(l.psocket->fd());
+        if (l.pinned.pinnedSegments() == 0 || now >= l.deadline)
+        {
+            std::swap(l, m_lingering.back());
+            m_lingering.pop_back(); // 关闭套接字，释放数据段
+        }
+        else
+        {
+            ++i;
+        }
+    }
 }
 
 // 设置 m_delayDeleteCallback
@@ -217,30 +349,127 @@ void EventLoop::setdelayDeleteCallback(std::function<void(int)> func)
 // 将Connection的fd添加到m_delayDeleteConnectionfd里
 void EventLoop::delayDelete(int fd)
 {
-    m_delayDeleteConnectionfd.insert(fd);
+    if (fd < 0 || fd >= static_cast<int>(m_connections.size()) || !m_connections[fd].pconn || m_connections[fd].closing)
+    {
+        return;
+    }
+
+    m_connections[fd].closing = true;
+    m_delayDeleteConnectionfd.push_back(fd);
 }
 
-// 删除m_delayDeleteConnectionfd里面所有的连接，并清空m_delayDeleteConnectionfd
+// 释放m_delayDeleteConnectionfd里面所有的连接，并清空m_delayDeleteConnectionfd
 void EventLoop::deleteConnection()
 {
+    for (auto fd : m_delayDeleteConnectionfd)
     {
-        std::lock_guard<std::mutex> lock(m_mtx);
-        for (auto fd : m_delayDeleteConnectionfd)
+        ConnectionSlot &slot = m_connections[fd];
+        unlink(fd);
+        slot.closing = false;
+        slot.pconn->removeFromLoop(); // 在I/O线程里从 Poller 移除，析构可能发生在工作线程
+        slot.pconn.reset(); // 工作线程没有持有该连接时，Connection对象在这里析构
+        m_connectioncount.fetch_sub(1, std::memory_order_relaxed);
+
+        // 通知 TcpServer 连接已经删除
+        m_delayDeleteCallback(fd);
+    }
+
+    m_delayDeleteConnectionfd.clear();
+}
+
+// 把有待发送数据的连接加入待发送列表
+void EventLoop::queueFlush(std::shared_ptr<Connection> pConn)
+{
+    m_pendingflush.push_back(std::move(pConn));
+}
+
+// 发送待发送列表里每个连接排队的数据，并清空待发送列表
+void EventLoop::flushPendingOutput()
+{
+    // 发送完成的回调里可能又会 send，新加入的连接也在本轮发送，不留到下一次 epoll_wait 之后
+    while (!m_pendingflush.empty())
+    {
+        m_flushing.swap(m_pendingflush);
+        for (auto &pconn : m_flushing)
         {
-            auto it = m_connectionmap.find(fd);
-            if (it != m_connectionmap.end())
-            {
-                m_lruconnection.erase(it->second);
-                m_connectionmap.erase(it); // 删除 m_connectionmap 里面已经断开的连接的映射
-            }
+            pconn->flush();
         }
+        m_flushing.clear();
+    }
+}
+
+// 获取当前事件循环持有的连接数，可以在任意线程调用
+size_t EventLoop::connectionCount() const
+{
+    return m_connectioncount.load(std::memory_order_relaxed);
+}
+
+// 把连接放到活跃链表的头部
+void EventLoop::linkfront(int fd)
+{
+    ConnectionSlot &slot = m_connections[fd];
+    slot.prev = -1;
+    slot.next = m_lruhead;
+    if (m_lruhead != -1)
+    {
+        m_connections[m_lruhead].prev = fd;
+    }
+    m_lruhead = fd;
+    if (m_lrutail == -1)
+    {
+        m_lrutail = fd;
     }
+}
 
-    // 删除 TcpServer 对象的Connection连接
-    for (auto fd : m_delayDeleteConnectionfd)
+// 把连接从活跃链表中摘下，不在链表中时什么也不做
+void EventLoop::unlink(int fd)
+{
+    ConnectionSlot &slot = m_connections[fd];
+    if (slot.prev == -1 && m_lruhead != fd) // 不在链表中
     {
-        m_delayDeleteCallback(fd);
+        return;
     }
 
-    m_delayDeleteConnectionfd.clear();
+    if (slot.prev != -1)
+    {
+        m_connections[slot.prev].next = slot.next;
+    }
+    else
+    {
+        m_lruhead = slot.next;
+    }
+
+    if (slot.next != -1)
+    {
+        m_connections[slot.next].prev = slot.prev;
+    }
+    else
+    {
+        m_lrutail = slot.prev;
+    }
+
+    slot.prev = -1;
+    slot.next = -1;
+}
+
+// 获取接收溢出区。同一个事件循环里的连接依次读取数据，共用这一块内存，只能在I/O线程中使用
+char* EventLoop::scratch()
+{
+    if (!m_scratch)
+    {
+        m_scratch.reset(new char[kScratchSize]);
+    }
+    return m_scratch.get();
+}
+
+// 获取接收溢出区的大小
+size_t EventLoop::scratchsize() const
+{
+    return kScratchSize;
+}
+
+// 获取事件循环的内存池，用来分配该事件循环上的 Socket、Channel、Connection
+const std::shared_ptr<ObjectPool>& EventLoop::objectpool() const
+{
+    return m_objectpool;
 }
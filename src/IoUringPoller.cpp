@@ -0,0 +1,586 @@
+#include "IoUringPoller.h"
+#include "Channel.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+
+IoUringPoller::IoUringPoller()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kEntries * 4; // 每个fd最多只有一个 poll 请求，完成队列给大一些，减少溢出
+
+    m_ringfd = static_cast<int>(::syscall(__NR_io_uring_setup, kEntries, &params));
+    if (m_ringfd == -1)
+    {
+        LOG(warn) << "io_uring_setup() err, errno=" << errno;
+        return;
+    }
+
+    // 需要 io_uring_enter 直接带超时时间等待（5.11+）
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        LOG(warn) << "io_uring does not support IORING_FEAT_EXT_ARG";
+        release();
+        return;
+    }
+
+    m_sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singlemmap = params.features & IORING_FEAT_SINGLE_MMAP; // 提交队列和完成队列共用一次映射
+    if (singlemmap)
+    {
+        m_sqsize = m_cqsize = std::max(m_sqsize, m_cqsize);
+    }
+
+    m_sqptr = ::mmap(nullptr, m_sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQ_RING);
+    if (m_sqptr == MAP_FAILED)
+    {
+        m_sqptr = nullptr;
+    }
+    else if (singlemmap)
+    {
+        m_cqptr = m_sqptr;
+    }
+    else
+    {
+        m_cqptr = ::mmap(nullptr, m_cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_CQ_RING);
+        if (m_cqptr == MAP_FAILED)
+        {
+            m_cqptr = nullptr;
+        }
+    }
+
+    m_sqessize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = ::mmap(nullptr, m_sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringfd, IORING_OFF_SQES);
+    m_sqes = sqes == MAP_FAILED ? nullptr : static_cast<struct io_uring_sqe*>(sqes);
+
+    if (m_sqptr == nullptr || m_cqptr == nullptr || m_sqes == nullptr)
+    {
+        LOG(warn) << "io_uring mmap() err, errno=" << errno;
+        release();
+        return;
+    }
+
+    char* sq = static_cast<char*>(m_sqptr);
+    m_sqhead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqtail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqmask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqarray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_sqentries = params.sq_entries;
+    m_sqlocaltail = *m_sqtail;
+
+    char* cq = static_cast<char*>(m_cqptr);
+    m_cqhead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqtail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqmask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    m_evs.reserve(64);
+
+    // 完成式 I/O 需要 recv 在没有数据时由内核内部等待可读（IORING_FEAT_FAST_POLL，5.7+），而不是交给内核线程阻塞读，
+    // 还需要接收缓冲区环（5.19+）。不支持时连接仍然按就绪事件自己读写
+    if (!(params.features & IORING_FEAT_FAST_POLL) || !setupbufring())
+    {
+        LOG(warn) << "io_uring does not support recv with provided buffers, connection I/O stays readiness-based";
+        return;
+    }
+    m_asyncio = true;
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    // 先关闭 io_uring，内核不再引用请求里的内存，再释放还没完成的 sendmsg 请求持有的连接。
+    // 这些连接的Channel还在状态表里，析构时不能再回头修改已经不存在的 Poller
+    release();
+    for (FdState& st : m_fds)
+    {
+        if (st.sendkeep && st.pchannel != nullptr)
+        {
+            st.pchannel->setisinepoll(false);
+        }
+    }
+    m_fds.clear();
+    m_done.clear();
+}
+
+// io_uring 是否初始化成功
+bool IoUringPoller::valid() const
+{
+    return m_ringfd != -1;
+}
+
+// 按照Channel的m_events属性添加或修改监视的事件，只记录下来，下一轮等待之前统一提交
+int IoUringPoller::updatechannel(Channel* pchannel)
+{
+    int fd = pchannel->getfd();
+    FdState& st = state(fd);
+    st.pchannel = pchannel;
+    pchannel->setisinepoll();
+
+    uint32_t mask = pchannel->getevents() & (EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP);
+    if (st.armed && st.armedmask == mask) // 已经提交的请求监视的就是这些事件，什么也不用做
+    {
+        st.mask = mask;
+        return 0;
+    }
+
+    if (st.armed) // 监视的事件变了，让旧请求失效，下一轮按新的事件重新提交
+    {
+        disarm(fd);
+    }
+    st.mask = mask;
+    if (mask != 0)
+    {
+        markpending(fd);
+    }
+    return 0;
+}
+
+// 将Channel从监视中移除
+int IoUringPoller::removechannel(Channel* pchannel)
+{
+    int fd = pchannel->getfd();
+    FdState& st = state(fd);
+    if (st.armed)
+    {
+        disarm(fd);
+    }
+
+    // 取消还没完成的 recv/sendmsg 请求。sendmsg 请求的 keepalive 留到它的完成事件到达时再释放：取消之前内核可能还在读数据
+    if (st.recving)
+    {
+        cancel(userdata(fd, kOpRecv, st.iogen));
+    }
+    if (st.sendkeep)
+    {
+        cancel(userdata(fd, kOpSend, st.iogen));
+    }
+    st.recving = false;
+    st.recvwait = false;
+    ++st.iogen;
+
+    ++st.gen; // 本轮已经到达、还没取出的完成事件也作废
+    st.pchannel = nullptr;
+    st.mask = 0;
+    pchannel->setisinepoll(false);
+    return 0;
+}
+
+// 提交本轮积累的请求，并等待事件发生
+EpollEvents IoUringPoller::poll(int& timeout)
+{
+    // 上一轮的完成事件都已经处理完：接收缓冲区里的数据已经拷走，完成的 sendmsg 请求持有的对象可以释放了
+    recyclebufs();
+    m_done.clear();
+
+    // 上一轮因为接收缓冲区用完而失败的 recv 请求重新提交
+    for (int fd : m_recvwaitfds)
+    {
+        FdState& st = m_fds[fd];
+        if (st.recvwait)
+        {
+            st.recvwait = false;
+            preprecv(fd);
+        }
+    }
+    m_recvwaitfds.clear();
+
+    // 为上一轮触发过的、和监视事件有变化的fd提交 poll 请求
+    for (int fd : m_pendingfds)
+    {
+        FdState& st = m_fds[fd];
+        st.pending = false;
+        if (st.pchannel != nullptr && st.mask != 0 && !st.armed)
+        {
+            arm(fd);
+        }
+    }
+    m_pendingfds.clear();
+
+    // 完成队列里已经有事件，或者不需要等待，就不等待
+    bool haveevents = *m_cqhead != __atomic_load_n(m_cqtail, __ATOMIC_ACQUIRE);
+    if (timeout != 0 && !haveevents)
+    {
+        if (enter(m_tosubmit, 1, timeout) == -1 && errno != EINTR && errno != ETIME && errno != EBUSY)
+        {
+            LOG(error) << "io_uring_enter() err, errno=" << errno;
+            timeout = -1;
+            return EpollEvents();
+        }
+    }
+    else if (m_tosubmit > 0) // 只提交，不等待
+    {
+        enter(m_tosubmit, 0, 0);
+    }
+    timeout = 0;
+
+    reap();
+    return EpollEvents(m_evs.data(), static_cast<int>(m_evs.size()));
+}
+
+// 是否支持完成式 I/O
+bool IoUringPoller::asyncio() const
+{
+    return m_asyncio;
+}
+
+// 为Channel提交一个 recv 请求，数据读进接收缓冲区环里的一块
+void IoUringPoller::submitrecv(Channel* pchannel)
+{
+    int fd = pchannel->getfd();
+    FdState& st = state(fd);
+    st.pchannel = pchannel;
+    pchannel->setisinepoll();
+
+    st.recving = true;
+    preprecv(fd);
+}
+
+// 为Channel提交一个 sendmsg 请求，keepalive 持有到请求完成
+void IoUringPoller::submitsendmsg(Channel* pchannel, const struct msghdr* msg, int flags, std::shared_ptr<void> keepalive)
+{
+    int fd = pchannel->getfd();
+    FdState& st = state(fd);
+    st.pchannel = pchannel;
+    pchannel->setisinepoll();
+
+    struct io_uring_sqe* sqe = getsqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = userdata(fd, kOpSend, st.iogen);
+    st.sendkeep = std::move(keepalive);
+}
+
+// 解除映射并关闭 io_uring
+void IoUringPoller::release()
+{
+    if (m_sqes != nullptr)
+    {
+        ::munmap(m_sqes, m_sqessize);
+        m_sqes = nullptr;
+    }
+    if (m_cqptr != nullptr && m_cqptr != m_sqptr)
+    {
+        ::munmap(m_cqptr, m_cqsize);
+    }
+    m_cqptr = nullptr;
+    if (m_sqptr != nullptr)
+    {
+        ::munmap(m_sqptr, m_sqsize);
+        m_sqptr = nullptr;
+    }
+    if (m_ringfd != -1)
+    {
+        ::close(m_ringfd);
+        m_ringfd = -1;
+    }
+    if (m_bufring != nullptr)
+    {
+        ::munmap(m_bufring, m_bufringsize);
+        m_bufring = nullptr;
+    }
+    if (m_bufbase != nullptr)
+    {
+        ::munmap(m_bufbase, static_cast<size_t>(kRecvBufCount) * kRecvBufSize);
+        m_bufbase = nullptr;
+    }
+}
+
+// 组合请求的 user_data
+uint64_t IoUringPoller::userdata(int fd, Op op, uint32_t gen)
+{
+    return (static_cast<uint64_t>(fd) << 32) | (op << 30) | (gen & kGenMask);
+}
+
+// 获取 fd 的状态，必要时扩容
+IoUringPoller::FdState& IoUringPoller::state(int fd)
+{
+    if (fd >= static_cast<int>(m_fds.size()))
+    {
+        m_fds.resize(std::max<size_t>(fd + 1, m_fds.size() * 2));
+    }
+    return m_fds[fd];
+}
+
+// 让 fd 在下一轮等待之前提交 poll 请求
+void IoUringPoller::markpending(int fd)
+{
+    FdState& st = m_fds[fd];
+    if (!st.pending)
+    {
+        st.pending = true;
+        m_pendingfds.push_back(fd);
+    }
+}
+
+// 提交 poll-add 请求
+void IoUringPoller::arm(int fd)
+{
+    FdState& st = m_fds[fd];
+    struct io_uring_sqe* sqe = getsqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = st.mask; // POLLIN/POLLOUT/POLLPRI/POLLRDHUP 和对应的 EPOLL* 取值相同
+    sqe->user_data = userdata(fd, kOpPoll, st.gen);
+    st.armed = true;
+    st.armedmask = st.mask;
+}
+
+// 提交 poll-remove 请求，让还没完成的 poll 请求失效
+void IoUringPoller::disarm(int fd)
+{
+    FdState& st = m_fds[fd];
+    struct io_uring_sqe* sqe = getsqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = userdata(fd, kOpPoll, st.gen); // 要取消的请求的 user_data
+    sqe->user_data = kIgnoreData;
+    st.armed = false;
+    ++st.gen; // 被取消的请求即使已经完成，它的完成事件也会因为代数不同被丢弃
+}
+
+// 提交 recv 请求：不指定缓冲区，数据到达时内核从接收缓冲区环里取一块
+void IoUringPoller::preprecv(int fd)
+{
+    FdState& st = m_fds[fd];
+    struct io_uring_sqe* sqe = getsqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufGroup;
+    sqe->user_data = userdata(fd, kOpRecv, st.iogen);
+}
+
+// 提交取消请求，target 是要取消的请求的 user_data
+void IoUringPoller::cancel(uint64_t target)
+{
+    struct io_uring_sqe* sqe = getsqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = kIgnoreData;
+}
+
+// 注册接收缓冲区环，失败时不支持完成式 I/O
+bool IoUringPoller::setupbufring()
+{
+    m_bufringsize = kRecvBufCount * sizeof(struct io_uring_buf);
+    void* ring = ::mmap(nullptr, m_bufringsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        return false;
+    }
+    m_bufring = static_cast<struct io_uring_buf_ring*>(ring);
+
+    // 缓冲区的物理内存在第一次被写入时才分配
+    void* base = ::mmap(nullptr, static_cast<size_t>(kRecvBufCount) * kRecvBufSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return false;
+    }
+    m_bufbase = static_cast<char*>(base);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_bufring);
+    reg.ring_entries = kRecvBufCount;
+    reg.bgid = kBufGroup;
+    if (::syscall(__NR_io_uring_register, m_ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    {
+        return false;
+    }
+
+    // 所有的缓冲区都放进环里
+    for (unsigned bid = 0; bid < kRecvBufCount; ++bid)
+    {
+        m_usedbufs.push_back(static_cast<uint16_t>(bid));
+    }
+    recyclebufs();
+    return true;
+}
+
+// 把上一轮交给Channel的接收缓冲区放回环里
+void IoUringPoller::recyclebufs()
+{
+    if (m_usedbufs.empty())
+    {
+        return;
+    }
+
+    // 环就是 io_uring_buf 数组，尾部和第0项的 resv 重叠。不用 m_bufring->bufs：
+    // 头文件里的柔性数组前面有一个空结构体，C++ 里它占1个字节，bufs 的偏移是8而不是0
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(m_bufring);
+    for (uint16_t bid : m_usedbufs)
+    {
+        struct io_uring_buf& buf = bufs[m_buftail & (kRecvBufCount - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(m_bufbase + static_cast<size_t>(bid) * kRecvBufSize);
+        buf.len = kRecvBufSize;
+        buf.bid = bid;
+        ++m_buftail;
+    }
+    __atomic_store_n(&m_bufring->tail, m_buftail, __ATOMIC_RELEASE); // 缓冲区填好之后再发布新的尾部
+    m_usedbufs.clear();
+}
+
+// 获取一个空闲的提交队列项，提交队列满了先提交
+struct io_uring_sqe* IoUringPoller::getsqe()
+{
+    if (m_sqlocaltail - __atomic_load_n(m_sqhead, __ATOMIC_ACQUIRE) >= m_sqentries)
+    {
+        enter(m_tosubmit, 0, 0);
+    }
+
+    unsigned index = m_sqlocaltail & *m_sqmask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqarray[index] = index;
+    ++m_sqlocaltail;
+    ++m_tosubmit;
+    return sqe;
+}
+
+// 调用 io_uring_enter 提交请求并等待，mincomplete 为0时不等待
+int IoUringPoller::enter(unsigned submit, unsigned mincomplete, int timeout)
+{
+    __atomic_store_n(m_sqtail, m_sqlocaltail, __ATOMIC_RELEASE); // 把填好的提交队列项发布给内核
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+    if (mincomplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout >= 0)
+        {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+
+    int ret = static_cast<int>(::syscall(__NR_io_uring_enter, m_ringfd, submit, mincomplete, flags,
+                                         mincomplete > 0 ? &arg : nullptr, mincomplete > 0 ? sizeof(arg) : 0));
+    if (ret >= 0)
+    {
+        m_tosubmit -= std::min<unsigned>(m_tosubmit, ret);
+    }
+    return ret;
+}
+
+// 从完成队列里取出所有的完成事件
+void IoUringPoller::reap()
+{
+    m_evs.clear();
+
+    unsigned head = *m_cqhead;
+    unsigned tail = __atomic_load_n(m_cqtail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe& cqe = m_cqes[head & *m_cqmask];
+        if (cqe.user_data == kIgnoreData)
+        {
+            continue;
+        }
+
+        int fd = static_cast<int>(cqe.user_data >> 32);
+        Op op = static_cast<Op>((cqe.user_data >> 30) & 3);
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data) & kGenMask;
+        if (fd >= static_cast<int>(m_fds.size()))
+        {
+            continue;
+        }
+        FdState& st = m_fds[fd];
+
+        if (op == kOpSend)
+        {
+            // 不管请求是否已经作废，完成之后内核都不再引用它的数据，持有的对象交给 m_done 释放
+            m_done.push_back(std::move(st.sendkeep));
+            if ((st.iogen & kGenMask) != gen || st.pchannel == nullptr)
+            {
+                continue;
+            }
+            st.pchannel->setsendresult(cqe.res);
+
+            struct epoll_event ev;
+            ev.events = kSendDone;
+            ev.data.ptr = st.pchannel;
+            m_evs.push_back(ev);
+            continue;
+        }
+
+        if (op == kOpRecv)
+        {
+            // 内核取走的接收缓冲区，不管请求是否已经作废，处理完这一轮的事件之后都要放回环里
+            const char* data = nullptr;
+            if (cqe.flags & IORING_CQE_F_BUFFER)
+            {
+                uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                data = m_bufbase + static_cast<size_t>(bid) * kRecvBufSize;
+                m_usedbufs.push_back(bid);
+            }
+            if ((st.iogen & kGenMask) != gen || !st.recving || st.pchannel == nullptr)
+            {
+                continue;
+            }
+            if (cqe.res == -ENOBUFS) // 这一轮的接收缓冲区用完了，下一轮放回之后重新提交，不交给Channel
+            {
+                st.recvwait = true;
+                m_recvwaitfds.push_back(fd);
+                continue;
+            }
+            st.recving = false;
+            st.pchannel->setrecvresult(data, cqe.res);
+
+            struct epoll_event ev;
+            ev.events = kRecvDone;
+            ev.data.ptr = st.pchannel;
+            m_evs.push_back(ev);
+            continue;
+        }
+
+        if ((st.gen & kGenMask) != gen || !st.armed) // 已经被修改或者移除的 poll 请求
+        {
+            continue;
+        }
+
+        st.armed = false; // 一次性的请求已经失效
+        if (cqe.res < 0) // 请求出错（例如 -EBADF、-EINVAL），重新提交只会立即再失败，不再监视，等连接超时被淘汰
+        {
+            LOG(error) << "io_uring poll err, fd=" << fd << ", res=" << cqe.res;
+            continue;
+        }
+
+        if (st.mask != 0) // 处理完事件之后重新提交
+        {
+            markpending(fd);
+        }
+
+        // 和 epoll 一样只报告监视的事件以及 EPOLLERR/EPOLLHUP：对端关闭写端后内核会带上 EPOLLRDHUP，
+        // 没有监视它的连接（例如对端半关闭后还在发送回复）不能被当成对端关闭
+        uint32_t events = static_cast<uint32_t>(cqe.res) & (st.armedmask | EPOLLERR | EPOLLHUP);
+        if (events == 0)
+        {
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = st.pchannel;
+        m_evs.push_back(ev);
+    }
+
+    __atomic_store_n(m_cqhead, head, __ATOMIC_RELEASE);
+}
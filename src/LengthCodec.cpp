@@ -0,0 +1,171 @@
+#include "LengthCodec.h"
+#include "Connection.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cassert>
+
+// 把这批帧的所有权转移出来，不拷贝消息体
+std::shared_ptr<FrameBatch> FrameBatch::detach()
+{
+    auto owned = std::make_shared<FrameBatch>();
+    if (m_source == nullptr)
+    {
+        return owned;
+    }
+
+    // 移动 Buffer 只是交换底层 vector 的指针，消息体的地址不变，视图继续有效
+    owned->m_frames = std::move(m_frames);
+    owned->m_storage.emplace(std::move(*m_source));
+
+    // 末尾不完整的帧拷贝回读缓冲区，等后续数据到达
+    Buffer& storage = *owned->m_storage;
+    storage.retrieve(m_consumed);
+    m_source->append(storage.peek(), storage.readableBytes());
+
+    m_frames.clear();
+    m_source = nullptr;
+    m_consumed = 0;
+    return owned;
+}
+
+LengthCodec::LengthCodec(size_t headerlen, Endian endian, size_t maxframe)
+    : m_headerlen(headerlen),
+      m_endian(endian),
+      m_maxframe(maxframe)
+{
+    assert(headerlen == 1 || headerlen == 2 || headerlen == 4 || headerlen == 8);
+    assert(headerlen <= Buffer::kCheapPrepend); // 长度头要放得进 Buffer 的前缀区域
+
+    // 最大消息体长度不能超过长度头能表示的范围
+    if (headerlen < 8)
+    {
+        m_maxframe = std::min<uint64_t>(m_maxframe, (uint64_t(1) << (headerlen * 8)) - 1);
+    }
+}
+
+// 设置 m_framecb
+void LengthCodec::setframecb(FrameCallback func)
+{
+    m_framecb = std::move(func);
+}
+
+// 从连接的读缓冲区里解析出所有完整的帧，交给 m_framecb，然后消费掉这些帧
+void LengthCodec::onmessage(const std::shared_ptr<Connection>& pConn, Buffer* buf) const
+{
+    // 每个I/O线程复用一个批次对象，帧视图数组的内存不用每次重新申请
+    thread_local FrameBatch batch;
+    batch.m_frames.clear();
+    batch.m_source = buf;
+    batch.m_consumed = 0;
+
+    const char* data = buf->peek();
+    size_t readable = buf->readableBytes();
+    bool toolarge = false;
+    while (readable - batch.m_consumed >= m_headerlen)
+    {
+        uint64_t len = readheader(data + batch.m_consumed);
+        if (len > m_maxframe) // 防止对端用一个巨大的长度头耗尽内存
+        {
+            toolarge = true;
+            break;
+        }
+        if (readable - batch.m_consumed - m_headerlen < len) // 不是一条完整的数据，等下次接收余下的部分
+        {
+            break;
+        }
+
+        batch.m_frames.emplace_back(data + batch.m_consumed + m_headerlen, len);
+        batch.m_consumed += m_headerlen + len;
+    }
+
+    if (!batch.m_frames.empty() && m_framecb)
+    {
+        m_framecb(pConn, batch);
+    }
+
+    // 回调里没有 detach，帧还在读缓冲区里，在这里消费掉
+    if (batch.m_source != nullptr)
+    {
+        buf->retrieve(batch.m_consumed);
+    }
+    batch.m_frames.clear();
+    batch.m_source = nullptr;
+
+    if (toolarge)
+    {
+        LOG(warn) << "frame exceeds max length " << m_maxframe << ", fd=" << pConn->fd();
+        pConn->closeconnection();
+    }
+}
+
+// 在 buf 的可读数据前面加上长度头，消息体超过最大长度时返回false
+bool LengthCodec::encode(Buffer* buf) const
+{
+    // m_maxframe 不超过长度头能表示的范围，检查它就够了
+    if (buf->readableBytes() > m_maxframe)
+    {
+        LOG(error) << "encode() body length " << buf->readableBytes() << " exceeds max length " << m_maxframe;
+        return false;
+    }
+
+    char header[8];
+    writeheader(header, buf->readableBytes());
+    buf->prepend(header, m_headerlen);
+    return true;
+}
+
+// 把 buf 的可读数据作为消息体加上长度头，移动给连接发送，不拷贝
+bool LengthCodec::send(const std::shared_ptr<Connection>& pConn, Buffer&& buf) const
+{
+    if (!encode(&buf))
+    {
+        return false;
+    }
+    pConn->send(std::move(buf));
+    return true;
+}
+
+// 拷贝一次消息体，加上长度头后发送
+bool LengthCodec::send(const std::shared_ptr<Connection>& pConn, std::string_view body) const
+{
+    if (body.size() > m_maxframe) // 先检查，不拷贝注定发不出去的消息体
+    {
+        LOG(error) << "send() body length " << body.size() << " exceeds max length " << m_maxframe;
+        return false;
+    }
+
+    Buffer buf(body.size());
+    buf.append(body.data(), body.size());
+    return send(pConn, std::move(buf));
+}
+
+// 长度头的字节数
+size_t LengthCodec::headerlen() const
+{
+    return m_headerlen;
+}
+
+// 解析长度头
+uint64_t LengthCodec::readheader(const char* p) const
+{
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    uint64_t len = 0;
+    for (size_t i = 0; i < m_headerlen; ++i)
+    {
+        size_t idx = m_endian == Endian::Big ? i : m_headerlen - 1 - i;
+        len = (len << 8) | u[idx];
+    }
+    return len;
+}
+
+// 填写长度头
+void LengthCodec::writeheader(char* p, uint64_t len) const
+{
+    for (size_t i = 0; i < m_headerlen; ++i)
+    {
+        size_t idx = m_endian == Endian::Big ? m_headerlen - 1 - i : i;
+        p[idx] = static_cast<char>(len & 0xff);
+        len >>= 8;
+    }
+}
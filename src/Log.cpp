@@ -1,7 +1,11 @@
 #include "Log.h"
 #include "AsyncLogging.h"
+#include "BinaryLog.h"
 #include "TimesTamp.h"
 
+#include <algorithm>
+#include <cstring>
+#include <ctime>
 #include <unistd.h>
 #include <sys/syscall.h>
 
@@ -9,8 +13,50 @@
 Log::OutputTarget Log::output_target_ = Log::CONSOLE;
 std::ofstream Log::log_file_;
 std::string Log::output_file_name_;
+std::mutex Log::m_mtx;
+std::atomic<int> Log::level_(Log::debug);
+std::atomic<int> Log::format_(Log::TEXT);
+
+namespace
+{
+    // 每个线程缓存自己的线程ID和它的字符串形式，只在线程第一次写日志时调用一次 gettid
+    struct ThreadIdCache
+    {
+        long id;
+        char str[24];
+        size_t len;
+
+        ThreadIdCache()
+            : id(syscall(SYS_gettid))
+        {
+            len = snprintf(str, sizeof(str), "%ld", id);
+        }
+    };
+
+    // 每个线程缓存最近一次格式化的秒和对应的 "YYYY-MM-DD HH:MM:SS" 字符串，同一秒内不再调用 localtime_r 和 strftime
+    struct TimeCache
+    {
+        time_t second = -1;
+        char str[32];
+        size_t len = 0;
+    };
+
+    thread_local ThreadIdCache t_tid;
+    thread_local TimeCache t_time;
+
+    // 把 0-999999 的微秒数格式化成固定 6 位的十进制数
+    void formatMicros(char *p, long us)
+    {
+        for (int i = 5; i >= 0; --i)
+        {
+            p[i] = static_cast<char>('0' + us % 10);
+            us /= 10;
+        }
+    }
+}
 
 /*
+    日志头格式：[级别][PID:线程ID][YYYY-MM-DD HH:MM:SS.微秒][文件:行号][函数名]
     %Y: 四位数年份（如 2024）
     %m: 两位数月份（01-12）
     %d: 两位数日期（01-31）
@@ -18,43 +64,192 @@ std::string Log::output_file_name_;
     %M: 分钟（00-59）
     %S: 秒数（00-59）
 */
-Log::Log(Level lv, const char *file, int line, const char *func)
-    : lv_(lv)
+Log::Log(const LogSite &site)
+    : len_(0),
+      lv_(site.level),
+      binary_(format_.load(std::memory_order_relaxed) == BINARY && AsyncLogging::exist)
 {
-    auto now = std::chrono::system_clock::now(); // 获取当前时间点
-    std::time_t t = std::chrono::system_clock::to_time_t(now); // 转成time_t格式（/* Seconds since the Epoch.  */）
-    std::tm tm = *std::localtime(&t); // 转成本地时间结构
-    os_ << '[' << level2str(lv) << ']'
-        << "[PID:" << syscall(SYS_gettid) << ']' // 线程ID
-        << '[' << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << ']'
-        << '[' << file << ':' << line << ']'
-        << '[' << func << "] ";
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // vDSO 实现，不陷入内核
+
+    if (binary_) // 二进制格式只记录调用点编号、时间戳和线程ID，记录的长度在析构时填写
+    {
+        BinaryLog::EventHeader header;
+        header.size = 0;
+        header.site = BinaryLog::siteId(site);
+        header.time = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        header.tid = static_cast<uint32_t>(t_tid.id);
+        header.reserved = 0;
+        memcpy(buf_, &header, sizeof(header));
+        len_ = sizeof(header);
+        return;
+    }
+
+    TimeCache &tc = t_time;
+    if (ts.tv_sec != tc.second) // 进入新的一秒才重新格式化日期和时间
+    {
+        std::tm tm;
+        localtime_r(&ts.tv_sec, &tm);
+        tc.len = strftime(tc.str, sizeof(tc.str), "%Y-%m-%d %H:%M:%S", &tm);
+        tc.second = ts.tv_sec;
+    }
+
+    char micros[6];
+    formatMicros(micros, ts.tv_nsec / 1000);
+
+    append("[", 1);
+    append(level2str(lv_), 5);
+    append("][PID:", 6);
+    append(t_tid.str, t_tid.len); // 线程ID
+    append("][", 2);
+    append(tc.str, tc.len);
+    append(".", 1);
+    append(micros, sizeof(micros));
+    append("][", 2);
+    append(site.file);
+    append(":", 1);
+    appendSigned(site.line);
+    append("][", 2);
+    append(site.func);
+    append("] ", 2);
 }
 
 // 触发析构函数的时候才输出日志内容
-Log::~Log() 
+Log::~Log()
 {
+    if (binary_)
+    {
+        uint32_t size = static_cast<uint32_t>(len_);
+        memcpy(buf_, &size, sizeof(size)); // 补上记录的长度
+        if (AsyncLogging::exist) // 二进制记录只能交给异步日志，退出阶段日志单例已经析构时丢弃
+        {
+            AsyncLogging::getInstance()->Append(buf_, len_);
+        }
+        return;
+    }
+
+    buf_[len_++] = '\n'; // append 最多写到 kLineSize - 1，总有一个字节留给换行符
+
     if (AsyncLogging::exist) // 如果定义了 AsyncLogging 类的单例对象，就可以使用异步日志输出
     {
         AsyncLogging* asyncLog = AsyncLogging::getInstance();
         asyncLog->setOutput(&GetOutputStream());// 设置日志异步输出的目的地
-        auto msg = std::move(os_.str() + '\n');
-        // std::cout << msg << std::endl;
-        asyncLog->Append(msg.data(), msg.size()); // 向日志系统前端缓冲区写入日志
+        asyncLog->Append(buf_, len_); // 整行直接写入日志系统前端的缓冲区
     }
-    else //使用普通的同步日志输出 
+    else //使用普通的同步日志输出
     {
         std::lock_guard<std::mutex> lock(m_mtx); // GetOutputStream()的返回值是临界区，访问需要加锁
+        GetOutputStream().write(buf_, len_);
+    }
 
-        // std::string msg = std::move(os_.str() + '\n');
-        // std::cout << os_.str() << std::endl;
-        // GetOutputStream().write(msg.data(), msg.size());
+} //std::cerr 默认无缓冲，能保证日志及时输出，避免因程序崩溃导致日志丢失
+
+// 追加字符串，放不下的部分截断
+void Log::append(std::string_view s)
+{
+    append(s.data(), s.size());
+}
+
+// 追加长度为 len 的数据，放不下的部分截断
+void Log::append(const char *data, size_t len)
+{
+    if (binary_)
+    {
+        appendArg(BinaryLog::kString, data, len);
+        return;
+    }
+    size_t n = std::min(len, kLineSize - 1 - len_);
+    memcpy(buf_ + len_, data, n);
+    len_ += n;
+}
 
-        GetOutputStream() << os_.str() << '\n';
-        // GetOutputStream().flush();
+// 追加有符号整数
+void Log::appendSigned(long long v)
+{
+    if (binary_)
+    {
+        int64_t x = v;
+        appendArg(BinaryLog::kInt, &x, sizeof(x));
+        return;
     }
-    
-} //std::cerr 默认无缓冲，能保证日志及时输出，避免因程序崩溃导致日志丢失
+    if (v < 0)
+    {
+        append("-", 1);
+        appendUnsigned(0ULL - static_cast<unsigned long long>(v)); // 最小的负数取反也不会溢出
+    }
+    else
+    {
+        appendUnsigned(static_cast<unsigned long long>(v));
+    }
+}
+
+// 追加无符号整数
+void Log::appendUnsigned(unsigned long long v)
+{
+    if (binary_)
+    {
+        uint64_t x = v;
+        appendArg(BinaryLog::kUint, &x, sizeof(x));
+        return;
+    }
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    do
+    {
+        *--p = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    append(p, tmp + sizeof(tmp) - p);
+}
+
+// 追加浮点数
+void Log::appendDouble(double v)
+{
+    if (binary_)
+    {
+        appendArg(BinaryLog::kDouble, &v, sizeof(v));
+        return;
+    }
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%g", v);
+    append(tmp, n);
+}
+
+// 追加指针
+void Log::appendPointer(const void *p)
+{
+    if (binary_)
+    {
+        uint64_t x = reinterpret_cast<uintptr_t>(p);
+        appendArg(BinaryLog::kPointer, &x, sizeof(x));
+        return;
+    }
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%p", p);
+    append(tmp, n);
+}
+
+// 二进制格式下追加一个参数：一个字节的类型，字符串再加上 uint32_t 的长度，然后是原始字节。
+// 字符串放不下时截断，其他类型放不下时丢弃，记录总是完整可解析的
+void Log::appendArg(uint8_t type, const void *data, size_t len)
+{
+    size_t head = type == BinaryLog::kString ? 1 + sizeof(uint32_t) : 1;
+    size_t room = kLineSize - len_;
+    if (room < head || (type != BinaryLog::kString && room - head < len))
+    {
+        return;
+    }
+    len = std::min(len, room - head);
+
+    buf_[len_] = static_cast<char>(type);
+    if (type == BinaryLog::kString)
+    {
+        uint32_t n = static_cast<uint32_t>(len);
+        memcpy(buf_ + len_ + 1, &n, sizeof(n));
+    }
+    memcpy(buf_ + len_ + head, data, len);
+    len_ += head + len;
+}
 
 const char *Log::level2str(Level l)
 {
@@ -78,7 +273,21 @@ void Log::SetOutputTarget(OutputTarget target, const std::string& filename)
     if (output_target_ != target || (output_target_ == target && target == FILE && output_file_name_ != filename))
     {
         output_target_ = target;
-        if (target == FILE && !filename.empty())
+        if (target == FILE && !filename.empty() && AsyncLogging::exist)
+        {
+            // 使用异步日志时由日志线程直接写文件描述符，按大小和日期滚动，不再经过 log_file_
+            output_file_name_ = filename;
+            if (log_file_.is_open())
+            {
+                log_file_.close();
+            }
+            if (!AsyncLogging::getInstance()->setLogFile(filename))
+            {
+                std::cerr << "open " << filename << " failed" << std::endl;
+                output_target_ = CONSOLE; // 日志输出到控制台上
+            }
+        }
+        else if (target == FILE && !filename.empty())
         {
             output_file_name_ = filename;
             auto file = TimesTamp::now().tostringData(); // 将当前系统时间作为前缀
@@ -93,9 +302,16 @@ void Log::SetOutputTarget(OutputTarget target, const std::string& filename)
                 output_target_ = CONSOLE; // 日志输出到控制台上
             }
         }
-        else if (target == CONSOLE && log_file_.is_open()) // 关闭已经打开的文件
+        else if (target == CONSOLE) // 关闭已经打开的文件
         {
-            log_file_.close();
+            if (log_file_.is_open())
+            {
+                log_file_.close();
+            }
+            if (AsyncLogging::exist)
+            {
+                AsyncLogging::getInstance()->setLogFile("");
+            }
         }
     }
 }
@@ -110,3 +326,27 @@ std::ostream& Log::GetOutputStream()
 
     return std::cerr;
 }
+
+// 设置运行时的日志级别
+void Log::SetLevel(Level lv)
+{
+    level_.store(lv, std::memory_order_relaxed);
+}
+
+// 获取运行时的日志级别
+Log::Level Log::GetLevel()
+{
+    return static_cast<Level>(level_.load(std::memory_order_relaxed));
+}
+
+// 设置输出格式
+void Log::SetOutputFormat(OutputFormat format)
+{
+    format_.store(format, std::memory_order_relaxed);
+}
+
+// 获取输出格式
+Log::OutputFormat Log::GetOutputFormat()
+{
+    return static_cast<OutputFormat>(format_.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,228 @@
+#include "LogFile.h"
+#include "TimesTamp.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LogFile::LogFile(const std::string& basename, size_t rollSize, int fsyncInterval)
+    : m_basename(basename),
+      m_rollsize(rollSize),
+      m_fsyncinterval(fsyncInterval)
+{
+    time_t now = time(nullptr);
+    m_lastsync = now;
+    m_index = lastindex(now); // 同一天重启之后接着写最后一个文件，写满了第一次写入时再滚动
+    open(now);
+}
+
+LogFile::LogFile(int fd)
+    : m_rollsize(0),
+      m_fsyncinterval(-1),
+      m_fd(fd),
+      m_ownfd(false)
+{
+}
+
+LogFile::~LogFile()
+{
+    if (m_ownfd && m_fd >= 0)
+    {
+        if (m_dirty)
+        {
+            ::fdatasync(m_fd);
+        }
+        ::close(m_fd);
+    }
+}
+
+// 设置文件头
+void LogFile::setheader(std::function<std::string()> header)
+{
+    m_header = std::move(header);
+}
+
+// 文件是否打开成功
+bool LogFile::isopen() const
+{
+    return m_fd >= 0;
+}
+
+// 当前文件已经写入的字节数
+size_t LogFile::written() const
+{
+    return m_written;
+}
+
+// 获取当前日期、当前序号对应的文件名
+std::string LogFile::filename(time_t now) const
+{
+    std::string name = TimesTamp(now).tostringData(); // 将当前日期作为前缀
+    name += "_";
+    name += m_basename;
+    if (m_index > 0)
+    {
+        name += ".";
+        name += std::to_string(m_index);
+    }
+    return name;
+}
+
+// 获取 now 所在日期已经存在的最大序号，一个文件都没有时返回0
+int LogFile::lastindex(time_t now) const
+{
+    std::string base = TimesTamp(now).tostringData() + "_" + m_basename + ".";
+    struct stat st;
+    int index = 0;
+    while (::stat((base + std::to_string(index + 1)).c_str(), &st) == 0)
+    {
+        ++index;
+    }
+    return index;
+}
+
+// 打开 now 所在日期、序号为 m_index 的文件
+bool LogFile::open(time_t now)
+{
+    std::string name = filename(now);
+    m_fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644); // 以追加的形式打开文件
+    if (m_fd < 0)
+    {
+        fprintf(stderr, "open log file %s failed: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 重启之后接着写同一个文件，大小从文件现有的长度算起
+    struct stat st;
+    m_written = ::fstat(m_fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+    m_needheader = true;
+
+    // 计算下一天0点，按本地时间滚动，和文件名里的日期一致
+    std::tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_mday += 1;
+    tm.tm_isdst = -1;
+    m_nextday = mktime(&tm);
+    return true;
+}
+
+// 关闭当前文件，打开下一个文件
+void LogFile::roll(time_t now)
+{
+    if (m_fd >= 0)
+    {
+        if (m_dirty)
+        {
+            ::fdatasync(m_fd);
+            m_dirty = false;
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_index = now >= m_nextday ? lastindex(now) : m_index + 1; // 新的一天从已经存在的最后一个文件开始，同一天按大小滚动时序号加1
+    m_lastsync = now;
+    open(now);
+}
+
+// 把 iov 里的数据按顺序写到文件
+void LogFile::append(struct iovec* iov, int iovcnt)
+{
+    time_t now = time(nullptr); // vDSO 实现，每轮只调用一次
+    if (m_ownfd && (m_fd < 0 || now >= m_nextday || m_written >= m_rollsize))
+    {
+        roll(now); // 上一次打开失败时也在这里重试
+    }
+    if (m_fd < 0)
+    {
+        return;
+    }
+
+    if (m_needheader)
+    {
+        m_needheader = false;
+        std::string header = m_header ? m_header() : std::string();
+        if (!header.empty() && !writeall(header.data(), header.size()))
+        {
+            return;
+        }
+    }
+
+    while (iovcnt > 0)
+    {
+        ssize_t n = ::writev(m_fd, iov, std::min(iovcnt, IOV_MAX));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (!m_failed) // 磁盘满之类的错误会一直持续，只报告一次，恢复之后再出错才再报告
+            {
+                fprintf(stderr, "write log file failed: %s\n", strerror(errno));
+                m_failed = true;
+            }
+            return;
+        }
+
+        m_written += n;
+        m_dirty = true;
+
+        // 跳过已经写完的数据段，只写了一部分的数据段从剩下的位置继续写
+        size_t left = static_cast<size_t>(n);
+        while (iovcnt > 0 && left >= iov->iov_len)
+        {
+            left -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (left > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    m_failed = false;
+
+    if (m_ownfd && m_fsyncinterval >= 0 && now - m_lastsync >= m_fsyncinterval)
+    {
+        ::fdatasync(m_fd);
+        m_lastsync = now;
+        m_dirty = false;
+    }
+}
+
+// 把长度为 len 的 data 全部写到文件
+bool LogFile::writeall(const char* data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(m_fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (!m_failed)
+            {
+                fprintf(stderr, "write log file failed: %s\n", strerror(errno));
+                m_failed = true;
+            }
+            return false;
+        }
+        m_written += n;
+        m_dirty = true;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
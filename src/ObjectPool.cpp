@@ -0,0 +1,106 @@
+#include "ObjectPool.h"
+
+#include <new>
+
+ObjectPool::ObjectPool()
+    : m_owner(std::thread::id()) // 事件循环开始运行后才绑定所属线程
+{
+}
+
+// 所有从内存池分配的对象都已经释放（分配器持有内存池），把缓存的块全部还给系统
+ObjectPool::~ObjectPool()
+{
+    for (SizeClass& sc : m_classes)
+    {
+        FreeNode* lists[2] = {sc.local, sc.remote.exchange(nullptr, std::memory_order_acquire)};
+        for (FreeNode* node : lists)
+        {
+            while (node)
+            {
+                FreeNode* next = node->next;
+                ::operator delete(node);
+                node = next;
+            }
+        }
+    }
+}
+
+// 把内存池绑定到当前线程，由事件循环在所在线程里调用
+void ObjectPool::bindthread()
+{
+    m_owner.store(std::this_thread::get_id(), std::memory_order_release);
+}
+
+// 当前线程是不是内存池所属的线程
+bool ObjectPool::isownerthread() const
+{
+    return m_owner.load(std::memory_order_acquire) == std::this_thread::get_id();
+}
+
+// 申请 size 字节的内存，可以在任意线程调用
+void* ObjectPool::allocate(size_t size)
+{
+    if (size > kMaxBlockSize)
+    {
+        return ::operator new(size);
+    }
+
+    size_t index = classindex(size);
+    if (!isownerthread()) // 本地链表只能由所属线程访问，其他线程直接向系统申请一个同样大小的块
+    {
+        return ::operator new(classsize(index));
+    }
+
+    SizeClass& sc = m_classes[index];
+    if (sc.local == nullptr) // 本地链表用完了，把其他线程归还的块整个取过来
+    {
+        sc.local = sc.remote.exchange(nullptr, std::memory_order_acquire);
+        sc.localcnt = 0;
+        for (FreeNode* node = sc.local; node; node = node->next)
+        {
+            ++sc.localcnt;
+        }
+    }
+
+    if (sc.local == nullptr)
+    {
+        return ::operator new(classsize(index));
+    }
+
+    FreeNode* node = sc.local;
+    sc.local = node->next;
+    --sc.localcnt;
+    return node;
+}
+
+// 归还 allocate 申请的内存，size 必须和申请时相同，可以在任意线程调用
+void ObjectPool::deallocate(void* p, size_t size)
+{
+    if (size > kMaxBlockSize)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    SizeClass& sc = m_classes[classindex(size)];
+    FreeNode* node = static_cast<FreeNode*>(p);
+
+    if (isownerthread())
+    {
+        if (sc.localcnt >= kMaxCached)
+        {
+            ::operator delete(p);
+            return;
+        }
+        node->next = sc.local;
+        sc.local = node;
+        ++sc.localcnt;
+    }
+    else // 其他线程压入远程链表，等所属线程取走
+    {
+        node->next = sc.remote.load(std::memory_order_relaxed);
+        while (!sc.remote.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#include "Poller.h"
+#include "Epoll.h"
+#include "IoUringPoller.h"
+
+// 工厂函数，创建 type 类型的 Poller。io_uring 初始化失败时记录日志并退回 epoll
+std::unique_ptr<Poller> Poller::create(PollerType type)
+{
+    if (type == PollerType::IoUring)
+    {
+        std::unique_ptr<IoUringPoller> puring = std::make_unique<IoUringPoller>();
+        if (puring->valid())
+        {
+            return puring;
+        }
+        LOG(warn) << "io_uring is unavailable, fall back to epoll";
+    }
+    return std::make_unique<Epoll>();
+}
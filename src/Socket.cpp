@@ -77,6 +77,30 @@ int Socket::setkeepaliveopt()
     return 0;
 }
 
+// 设置套接字的 SO_ZEROCOPY 属性
+int Socket::setzerocopyopt()
+{
+    int opt = 1;
+    // 允许 MSG_ZEROCOPY 发送，内核直接引用用户态的内存页，发送完成后通过错误队列通知
+    if (setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == -1)
+    {
+        LOG(error) << "setsockopt(SO_ZEROCOPY) err";
+        return -1;
+    }
+    return 0;
+}
+
+// 关闭写端，内核发送缓冲区里的数据发完之后发送 FIN
+int Socket::shutdownwrite()
+{
+    if (::shutdown(m_fd, SHUT_WR) == -1 && errno != ENOTCONN) // 对端已经断开时没有什么可关闭的
+    {
+        LOG(error) << "shutdown(SHUT_WR) err, errno=" << errno;
+        return -1;
+    }
+    return 0;
+}
+
 // 静态工厂方法，返回监听套接字对象
 Socket *Socket::getlistenfd()
 {
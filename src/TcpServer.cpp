@@ -1,13 +1,21 @@
 #include "TcpServer.h"
 
-TcpServer::TcpServer(const std::string &ip, uint16_t port, uint16_t nums)
-    : m_pmainloop(std::make_unique<EventLoop>(true)), // 创建主事件循环
-      m_acceptor(m_pmainloop.get(), ip, port), // 创建连接器
+TcpServer::TcpServer(const std::string &ip, uint16_t port, uint16_t nums, bool reuseport, PollerType poller, std::vector<int> iocpus)
+    : m_pmainloop(std::make_unique<EventLoop>(true, poller)), // 创建主事件循环
+      m_reuseport(reuseport),
       m_threadsnums(nums), // 设置从事件循环的个数（I/O线程的个数）
-      m_threadpool(m_threadsnums, "IO") // 创建I/O线程池，线程池里的每个线程都运行着一个从事件循环
+      m_threadpool(m_threadsnums, "IO", std::move(iocpus)) // 创建I/O线程池，线程池里的每个线程都运行着一个从事件循环
 {
-    m_acceptor.setonconnectcb([this](std::shared_ptr<Socket> pClientSocket)
-                              { createconnection(pClientSocket); });
+    if (!m_reuseport) // 默认模式，由主事件循环上唯一的连接器接收新连接，再分发给从事件循环
+    {
+        m_acceptor = std::make_unique<Acceptor>(m_pmainloop.get(), ip, port); // 创建连接器
+        m_acceptor->setonconnectcb([this](std::shared_ptr<Socket> pClientSocket)
+                                   {
+                                       // 把套接字交给从事件循环，由从事件循环在自己的I/O线程里创建Connection对象
+                                       EventLoop *ploop = m_psubloop[pClientSocket->fd() % m_threadsnums].get();
+                                       ploop->addTask([this, pClientSocket, ploop]()
+                                                      { createconnection(pClientSocket, ploop); }); });
+    }
 
     m_pmainloop->sethandletimeout([this](EventLoop *peloop)
                                   { eventlooptimeout(peloop); });
@@ -15,19 +23,25 @@ TcpServer::TcpServer(const std::string &ip, uint16_t port, uint16_t nums)
     // 创建从事件循环
     for (int i = 0; i < m_threadsnums; ++i)
     {
-        m_psubloop.emplace_back(std::make_unique<EventLoop>(false)); // 创建从事件循环
+        m_psubloop.emplace_back(std::make_unique<EventLoop>(false, poller)); // 创建从事件循环
         m_psubloop[i]->sethandletimeout([this](EventLoop *peloop)
                                         { eventlooptimeout(peloop); });
 
-        m_psubloop[i]->settimerCallback([this](int fd)
-                                        { removeTimeOutConnection(fd); });
-
         m_psubloop[i]->setdelayDeleteCallback([this](int fd)
                                         { deleteconnection(fd); });
 
-        // 将开启事件循环检测的函数放到线程池的任务队列里
-        m_threadpool.AddTask([this, i]()
-                             { m_psubloop[i]->loop(); });
+        if (m_reuseport) // reuseport 模式，每个从事件循环都有自己的连接器，新连接直接在本I/O线程内创建
+        {
+            EventLoop *ploop = m_psubloop[i].get();
+            m_subacceptors.emplace_back(std::make_unique<Acceptor>(ploop, ip, port));
+            m_subacceptors[i]->setonconnectcb([this, ploop](std::shared_ptr<Socket> pClientSocket)
+                                              { createconnection(pClientSocket, ploop); });
+        }
+
+        // 将开启事件循环检测的函数放到线程池的任务队列里。以下标为 key 提交有序任务，不会被其他线程窃取，
+        // 第 i 个从事件循环一定运行在第 i 个I/O线程上，和 iocpus 的绑定关系一一对应
+        m_threadpool.AddOrderedTask(i, [this, i]()
+                                    { m_psubloop[i]->loop(); });
     }
 }
 
@@ -56,41 +70,50 @@ void TcpServer::stop()
     m_threadpool.stop();
 }
 
-// 创建Connection对象
-void TcpServer::createconnection(const std::shared_ptr<Socket> &pClientSocket)
+// 创建Connection对象，在 ploop 所在的I/O线程中调用
+void TcpServer::createconnection(const std::shared_ptr<Socket> &pClientSocket, EventLoop *ploop)
 {
-    int fd = pClientSocket->fd();
+    auto pConn = std::allocate_shared<Connection>(PoolAllocator<Connection>(ploop->objectpool()), pClientSocket, ploop);
 
+    pConn->sethandlemessage([this](std::shared_ptr<Connection> pConn, Buffer* buffer)
+                            { handlemessage(pConn, buffer); });
+    pConn->setsendcomplete([this](std::shared_ptr<Connection> pConn)
+                           { sendcomplete(pConn); });
+
+    size_t threshold = m_zerocopythreshold.load(std::memory_order_relaxed);
+    if (threshold > 0)
     {
-        // 操作 m_clientConnectionMap 需要加锁
-        std::lock_guard<std::mutex> lock(m_mtx);
-        m_clientConnectionMap[fd] = std::make_shared<Connection>(pClientSocket, m_psubloop[pClientSocket->fd() % m_threadsnums].get());
+        pConn->setzerocopy(threshold);
     }
 
-    m_clientConnectionMap[fd]->sethandlemessage([this](std::shared_ptr<Connection> pConn, Buffer* buffer)
-                                                { handlemessage(pConn, buffer); });
-    m_clientConnectionMap[fd]->setsendcomplete([this](std::shared_ptr<Connection> pConn)
-                                               { sendcomplete(pConn); });
+    size_t high = m_highwatermark.load(std::memory_order_relaxed);
+    if (high > 0)
+    {
+        pConn->setwatermark(high, m_lowwatermark.load(std::memory_order_relaxed));
+        pConn->sethighwatermark([this](std::shared_ptr<Connection> pConn, size_t bytes)
+                                {
+                                    if (m_handlehighwatermark)
+                                        m_handlehighwatermark(pConn, bytes); });
+        pConn->setlowwatermark([this](std::shared_ptr<Connection> pConn, size_t bytes)
+                               {
+                                   if (m_handlelowwatermark)
+                                       m_handlelowwatermark(pConn, bytes); });
+    }
+    pConn->setinputlimit(m_inputlimit.load(std::memory_order_relaxed));
 
-    // 让从事件循环记录新创建的Connection对象
-    m_psubloop[pClientSocket->fd() % m_threadsnums]->newConnection(m_clientConnectionMap[fd]);
+    // 由从事件循环持有新创建的Connection对象
+    ploop->newConnection(pConn);
 
     // 在Connection对象创建出来之后，再让事件循环检测它的读事件。按照先创建，再激活的原则，防止竞态条件出现。
-    m_clientConnectionMap[fd]->addToEpoll();
+    pConn->addToEpoll();
 
     if (m_handlecreateconnectioncb)
         m_handlecreateconnectioncb(pClientSocket);
 }
 
-// 从clientConnectionMap中删除指定主键的Connection对象
+// 从事件循环删除Connection对象之后调用，通知上层
 void TcpServer::deleteconnection(int fd)
 {
-    {
-        // 操作 m_clientConnectionMap 需要加锁
-        std::lock_guard<std::mutex> lock(m_mtx);
-        m_clientConnectionMap.erase(fd);
-    }
-
     if (m_handledeleteconnectioncb)
         m_handledeleteconnectioncb(fd);
 }
@@ -143,12 +166,61 @@ void TcpServer::sethandleeventlooptimeout(std::function<void(EventLoop *)> func)
     m_handleeventlooptimeout = func;
 }
 
-// 从m_clientConnectionMap移除超时的Connection连接，由EventLoop对象通过回调的方式调用
-void TcpServer::removeTimeOutConnection(int fd)
+// 设置所有事件循环的空闲超时时间（毫秒）
+void TcpServer::setidletimeout(int ms)
+{
+    m_pmainloop->setidletimeout(ms);
+    for (auto &e : m_psubloop)
+    {
+        e->setidletimeout(ms);
+    }
+}
+
+// 设置从事件循环的忙轮询预算
+void TcpServer::setbusypoll(std::chrono::microseconds budget)
+{
+    for (auto &e : m_psubloop)
+    {
+        e->setbusypoll(budget);
+    }
+}
+
+// 设置新连接的零拷贝发送阈值
+void TcpServer::setzerocopy(size_t threshold)
+{
+    m_zerocopythreshold.store(threshold, std::memory_order_relaxed);
+}
+
+// 设置新连接写缓冲区的高、低水位线
+void TcpServer::setwatermark(size_t high, size_t low)
 {
+    m_highwatermark.store(high, std::memory_order_relaxed);
+    m_lowwatermark.store(low, std::memory_order_relaxed);
+}
+
+// 设置新连接读缓冲区的上限
+void TcpServer::setinputlimit(size_t limit)
+{
+    m_inputlimit.store(limit, std::memory_order_relaxed);
+}
+
+void TcpServer::sethandlehighwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func)
+{
+    m_handlehighwatermark = func;
+}
+
+void TcpServer::sethandlelowwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func)
+{
+    m_handlelowwatermark = func;
+}
+
+// 获取所有从事件循环持有的连接总数，可以在任意线程调用
+size_t TcpServer::connectionCount() const
+{
+    size_t cnt = 0;
+    for (auto &e : m_psubloop)
     {
-        // 操作 m_clientConnectionMap 需要加锁
-        std::lock_guard<std::mutex> lock(m_mtx);
-        m_clientConnectionMap.erase(fd);
+        cnt += e->connectionCount();
     }
-}
\ No newline at end of file
+    return cnt;
+}
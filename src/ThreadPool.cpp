@@ -1,56 +1,38 @@
 #include "ThreadPool.h"
 
+#include <pthread.h>
+#include <sched.h>
+
+static thread_local ThreadPool* t_pool = nullptr; // 当前线程所属的线程池，不属于任何线程池时为空
+static thread_local size_t t_index = 0;           // 当前线程在所属线程池里的下标
+
 // 启动 num 个线程
-ThreadPool::ThreadPool(size_t num, const std::string &type)
-    : m_stop(false), 
-      m_type(type)
+ThreadPool::ThreadPool(size_t num, const std::string &type, std::vector<int> cpus)
+    : m_next(0),
+      m_epoch(0),
+      m_idle(0),
+      m_slots(new std::atomic<uint64_t>[kOrderedSlots]),
+      m_rebalancedepth(0),
+      m_stop(false),
+      m_type(type),
+      m_cpus(std::move(cpus))
 {
+    // 先建好所有线程的任务队列，线程启动后就可能互相窃取
     for (size_t i = 0; i < num; ++i)
-    {   
-        m_threads.emplace_back(std::thread([this]()
-        {
-           {
-            LOG(info) <<  "create " << m_type << " thread(" << syscall(SYS_gettid) << ")";
-            // std::cout << "create " << m_type << " thread(" << syscall(SYS_gettid) << ")" << std::endl;
-           }
-            
-            while (true)
-            {
-                std::function<void()> task; // 用于存放出队任务
-                
-                { //////////////锁的作用域开始////////////////////////////////////
-                    std::unique_lock<std::mutex> lock(m_mutex);
-
-                    // 等待从任务队列中取出任务, 每 50ms 醒来一次检查，防止忙等
-                    while (!m_condition.wait_for(lock, std::chrono::milliseconds(50), [this](){
-                            return (m_stop.load() || !m_tasksqueue.empty());}))
-                    {
-                        if (m_stop.load() && m_tasksqueue.empty())
-                        {
-                            return ;
-                        }
-                    }
-
-                    if (m_stop.load() && m_tasksqueue.empty()) // 当关闭线程池并且任务队列为空时，退出线程
-                    {
-                        return ;
-                    }
-
-                    // 出队任务队列的队首任务，让当前线程执行这个任务
-                    task = std::move(m_tasksqueue.front());
-                    m_tasksqueue.pop();
-                    
-                    // // 析构函数调用后,如果任务队列里有任务。每次消耗掉一个任务之后，唤醒一个线程。
-                    // if (m_stop .load() && !m_tasksqueue.empty())
-                    // {
-                    //     m_condition.notify_one();
-                    // }
-                } //////////////锁的作用域结束////////////////////////////////////
-            
-                // std::cout << m_type << " thread is: " << syscall(SYS_gettid) << std::endl;
-                task();
-            } 
-        }));
+    {
+        m_workers.emplace_back(std::make_unique<Worker>());
+    }
+
+    // 槽位轮流绑定到各个线程，开始时都没有未完成的任务
+    for (size_t i = 0; i < kOrderedSlots; ++i)
+    {
+        m_slots[i].store(num == 0 ? 0 : static_cast<uint64_t>(i % num) << 32);
+    }
+
+    for (size_t i = 0; i < num; ++i)
+    {
+        m_threads.emplace_back(std::thread([this, i]()
+                                           { run(i); }));
     }
 }
 
@@ -62,8 +44,13 @@ size_t ThreadPool::size()
 
 void ThreadPool::stop()
 {
-    m_stop.store(true);       // 将线程池关闭按钮设置为true
-    m_condition.notify_all(); // 唤醒所有的线程
+    m_stop.store(true); // 将线程池关闭按钮设置为true
+
+    // 唤醒所有挂起的线程。在锁内通知，保证不会和正要挂起的线程错过
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_all();
+    }
 
     // 等待所有线程结束后再关闭线程池
     for (auto &e : m_threads)
@@ -79,4 +66,326 @@ ThreadPool::~ThreadPool()
     {
         stop();
     }
-}
\ No newline at end of file
+}
+
+// 提交一个任务
+void ThreadPool::submit(std::function<void()> task)
+{
+    if (m_workers.empty()) // 没有线程，直接在调用者线程执行
+    {
+        task();
+        return;
+    }
+
+    if (t_pool == this) // 线程池里的线程提交的任务放进自己的本地队列，其他线程空闲时会来窃取
+    {
+        Worker& self = *m_workers[t_index];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.local.push_back(std::move(task));
+        self.localsize.store(self.local.size(), std::memory_order_relaxed);
+    }
+    else // 外部线程提交的任务轮流压入各个线程的收件箱，不加锁
+    {
+        size_t index = m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+        m_workers[index]->inbox.push(std::move(task));
+    }
+
+    wakeone();
+}
+
+// 提交一个有序任务
+void ThreadPool::submitordered(size_t key, std::function<void()> task)
+{
+    if (m_workers.empty()) // 没有线程，直接在调用者线程执行
+    {
+        task();
+        return;
+    }
+
+    size_t slot = key % kOrderedSlots;
+    size_t depth = m_rebalancedepth.load(std::memory_order_relaxed);
+    uint64_t old = m_slots[slot].load();
+    uint64_t desired;
+    do
+    {
+        uint64_t worker = old >> 32;
+        uint64_t pending = old & 0xffffffff;
+
+        // 槽位上没有未完成的任务，换一个线程也不会打乱顺序
+        if (pending == 0 && depth != 0 && m_workers[worker]->orderedsize.load(std::memory_order_relaxed) > depth)
+        {
+            worker = leastloaded();
+        }
+        desired = (worker << 32) | (pending + 1);
+    } while (!m_slots[slot].compare_exchange_weak(old, desired));
+
+    Worker& target = *m_workers[desired >> 32];
+    target.orderedsize.fetch_add(1, std::memory_order_relaxed);
+    target.orderedinbox.push(OrderedTask{slot, std::move(task)});
+
+    // 任务只能由绑定的线程执行：它没有挂起时会自己看到新任务，挂起时唤醒所有挂起的线程，保证它能醒来
+    m_epoch.fetch_add(1);
+    if (target.parked.load())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_all();
+    }
+}
+
+// 某个线程的有序队列积压超过 depth 个任务时，允许把空闲的槽位迁移到积压最少的线程，0 表示不迁移
+void ThreadPool::setrebalancedepth(size_t depth)
+{
+    m_rebalancedepth.store(depth);
+}
+
+// 执行第 index 个线程的下一个有序任务，没有返回 false
+bool ThreadPool::runordered(size_t index)
+{
+    Worker& self = *m_workers[index];
+    if (self.ordered.empty())
+    {
+        if (self.orderedinbox.empty())
+        {
+            return false;
+        }
+        self.orderedinbox.consumeall([&self](OrderedTask& task)
+                                     { self.ordered.push_back(std::move(task)); });
+    }
+
+    OrderedTask task = std::move(self.ordered.front());
+    self.ordered.pop_front();
+    task.func();
+    task.func = nullptr; // 先释放任务捕获的对象，再把任务标记为完成
+
+    self.orderedsize.fetch_sub(1, std::memory_order_relaxed);
+    m_slots[task.slot].fetch_sub(1);
+    return true;
+}
+
+// 有序队列积压最少的线程
+size_t ThreadPool::leastloaded() const
+{
+    size_t best = 0;
+    size_t bestsize = m_workers[0]->orderedsize.load(std::memory_order_relaxed);
+    for (size_t i = 1; i < m_workers.size() && bestsize != 0; ++i)
+    {
+        size_t size = m_workers[i]->orderedsize.load(std::memory_order_relaxed);
+        if (size < bestsize)
+        {
+            best = i;
+            bestsize = size;
+        }
+    }
+    return best;
+}
+
+// 线程的主循环
+void ThreadPool::run(size_t index)
+{
+    // 先绑定CPU，再做其他事情：之后这个线程首次访问的内存（事件循环的溢出区、连接表、内存池等）都分配在本地NUMA节点上
+    int cpu = bindcpu(index);
+
+    t_pool = this;
+    t_index = index;
+
+    if (cpu >= 0)
+    {
+        unsigned int curcpu = 0, node = 0;
+        syscall(SYS_getcpu, &curcpu, &node, nullptr);
+        LOG(info) << "create " << m_type << " thread(" << syscall(SYS_gettid) << ") on cpu " << cpu << " node " << node;
+    }
+    else
+    {
+        LOG(info) << "create " << m_type << " thread(" << syscall(SYS_gettid) << ")";
+    }
+
+    Worker& self = *m_workers[index];
+    std::function<void()> task; // 用于存放出队任务
+    while (true)
+    {
+        // 有序任务和普通任务轮流优先
+        self.orderedfirst = !self.orderedfirst;
+        if (self.orderedfirst && runordered(index))
+        {
+            continue;
+        }
+
+        if (findtask(index, task))
+        {
+            task();
+            task = nullptr; // 立即释放任务捕获的对象（例如 shared_ptr<Connection>），不留到下一个任务
+            continue;
+        }
+
+        if (!self.orderedfirst && runordered(index))
+        {
+            continue;
+        }
+
+        // 准备挂起：先记下提交计数、登记为空闲，再找一遍任务。
+        // 提交任务的线程先入队再增加计数、再检查空闲线程数，所以两边至少有一边能看到对方：
+        // 要么这里再找一遍时能找到任务，要么提交的线程看到有空闲线程并唤醒它
+        uint64_t epoch = m_epoch.load();
+        m_idle.fetch_add(1);
+        self.parked.store(true);
+
+        if (!self.orderedinbox.empty())
+        {
+            self.parked.store(false);
+            m_idle.fetch_sub(1);
+            continue;
+        }
+
+        if (findtask(index, task))
+        {
+            self.parked.store(false);
+            m_idle.fetch_sub(1);
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        if (m_stop.load()) // 当关闭线程池并且所有任务队列都为空时，退出线程
+        {
+            self.parked.store(false);
+            m_idle.fetch_sub(1);
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this, epoch]()
+                             { return m_stop.load() || m_epoch.load() != epoch; });
+        }
+        self.parked.store(false);
+        m_idle.fetch_sub(1);
+    }
+}
+
+// 把第 index 个线程绑定到 m_cpus 里对应的CPU上
+int ThreadPool::bindcpu(size_t index)
+{
+    if (m_cpus.empty())
+    {
+        return -1;
+    }
+
+    int cpu = m_cpus[index % m_cpus.size()];
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        LOG(warn) << m_type << " thread " << index << ": invalid cpu " << cpu;
+        return -1;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) // CPU 不存在或者不在进程允许的CPU集合里，不绑定，继续运行
+    {
+        LOG(warn) << m_type << " thread " << index << ": bind cpu " << cpu << " failed, err=" << ret;
+        return -1;
+    }
+    return cpu;
+}
+
+// 为第 index 个线程找一个任务：本地队列 -> 自己的收件箱 -> 窃取其他线程的任务
+bool ThreadPool::findtask(size_t index, std::function<void()>& task)
+{
+    if (popLocal(index, task))
+    {
+        return true;
+    }
+
+    size_t cnt = drainInbox(*m_workers[index], index);
+    for (size_t k = 1; cnt == 0 && k < m_workers.size(); ++k)
+    {
+        cnt = steal((index + k) % m_workers.size(), index);
+    }
+
+    if (cnt > 1) // 一次拿到了多个任务，叫醒一个空闲的线程来分担
+    {
+        wakeone();
+    }
+    return cnt > 0 && popLocal(index, task);
+}
+
+// 从本地队列头部取一个任务
+bool ThreadPool::popLocal(size_t index, std::function<void()>& task)
+{
+    Worker& self = *m_workers[index];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    if (self.local.empty())
+    {
+        return false;
+    }
+
+    task = std::move(self.local.front());
+    self.local.pop_front();
+    self.localsize.store(self.local.size(), std::memory_order_relaxed);
+    return true;
+}
+
+// 把收件箱里的任务整批搬进第 index 个线程的本地队列，返回搬过来的任务个数
+size_t ThreadPool::drainInbox(Worker& from, size_t index)
+{
+    if (from.inbox.empty())
+    {
+        return 0;
+    }
+
+    Worker& self = *m_workers[index];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    size_t cnt = from.inbox.consumeall([&self](std::function<void()>& task)
+                                       { self.local.push_back(std::move(task)); });
+    self.localsize.store(self.local.size(), std::memory_order_relaxed);
+    return cnt;
+}
+
+// 从第 victim 个线程窃取任务放进第 index 个线程的本地队列，返回窃取的任务个数
+size_t ThreadPool::steal(size_t victim, size_t index)
+{
+    Worker& other = *m_workers[victim];
+    std::vector<std::function<void()>> stolen;
+
+    // 从本地队列尾部窃取一半，所属线程在头部取任务，两边很少争用同一端
+    if (other.localsize.load(std::memory_order_relaxed) > 0)
+    {
+        std::lock_guard<std::mutex> lock(other.mutex);
+        size_t cnt = (other.local.size() + 1) / 2;
+        stolen.reserve(cnt);
+        for (size_t i = 0; i < cnt; ++i)
+        {
+            stolen.push_back(std::move(other.local.back()));
+            other.local.pop_back();
+        }
+        other.localsize.store(other.local.size(), std::memory_order_relaxed);
+    }
+
+    if (stolen.empty()) // 本地队列是空的，所属线程可能正忙着执行一个长任务，把它收件箱里的任务取过来
+    {
+        return drainInbox(other, index);
+    }
+
+    // 两把锁不同时持有，避免两个线程互相窃取时死锁
+    Worker& self = *m_workers[index];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    for (auto it = stolen.rbegin(); it != stolen.rend(); ++it) // 保持原来的先后顺序
+    {
+        self.local.push_back(std::move(*it));
+    }
+    self.localsize.store(self.local.size(), std::memory_order_relaxed);
+    return stolen.size();
+}
+
+// 有挂起的线程时唤醒其中一个
+void ThreadPool::wakeone()
+{
+    m_epoch.fetch_add(1);
+    if (m_idle.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_condition.notify_one();
+    }
+}
+
@@ -9,14 +9,7 @@ Timer::Timer(std::chrono::nanoseconds first, std::chrono::nanoseconds interval)
         LOG(error) << "timerfd_create() err";
     }
 
-    struct itimerspec timeout = {0};
-    timeout.it_value = Timer::to_timespec(first); // 设置首次发生超时的时间
-    timeout.it_interval = Timer::to_timespec(interval); // 设置循环超时的时间（不包括首次）
-
-    if (timerfd_settime(m_timerfd, 0, &timeout, nullptr) == -1)
-    {
-        LOG(error) << "timerfd_settime() err";
-    }
+    settime(first, interval);
 }
 
 Timer::~Timer()
@@ -37,6 +30,19 @@ void Timer::wait()
     read(m_timerfd, &val, sizeof(val));
 }
 
+// 重新设置闹钟
+void Timer::settime(std::chrono::nanoseconds first, std::chrono::nanoseconds interval)
+{
+    struct itimerspec timeout = {0};
+    timeout.it_value = Timer::to_timespec(first); // 设置首次发生超时的时间
+    timeout.it_interval = Timer::to_timespec(interval); // 设置循环超时的时间（不包括首次）
+
+    if (timerfd_settime(m_timerfd, 0, &timeout, nullptr) == -1)
+    {
+        LOG(error) << "timerfd_settime() err";
+    }
+}
+
 // 将 ns 转换成 struct timespec
 timespec Timer::to_timespec(std::chrono::nanoseconds ns)
 {
@@ -0,0 +1,245 @@
+#include "TimerQueue.h"
+#include "EventLoop.h"
+#include "Channel.h"
+
+static const size_t kNotInHeap = static_cast<size_t>(-1);
+
+// 定时器节点
+struct TimerNode
+{
+    TimerQueue::TimePoint when;         // 到期时间
+    std::chrono::nanoseconds interval;  // 重复间隔，0表示只执行一次
+    std::function<void()> cb;           // 到期后执行的回调函数
+    uint64_t sequence = 0;              // 加入定时器队列的序号
+    size_t heapindex = kNotInHeap;      // 在堆中的下标
+    bool cancelled = false;             // 是否已经被取消（只在I/O线程中访问）
+};
+
+TimerQueue::TimerQueue(EventLoop *ploop)
+    : m_ploop(ploop),
+      m_timer(std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)), // 创建时不设置闹钟
+      m_ptimerchannel(std::make_unique<Channel>(ploop, std::make_shared<Socket>(m_timer.fd())))
+{
+    // 设置 事件循环检测到定时器超时 之后的回调函数
+    m_ptimerchannel->setreadeventcb([this]()
+                                    { handleRead(); });
+
+    // 让事件循环检测定时器的读事件
+    m_ptimerchannel->enablereading();
+}
+
+TimerQueue::~TimerQueue() = default;
+
+// 添加定时器，可以在任意线程调用
+TimerId TimerQueue::addTimer(TimePoint when, std::chrono::nanoseconds interval, std::function<void()> cb)
+{
+    auto pnode = std::make_shared<TimerNode>();
+    pnode->when = when;
+    pnode->interval = interval;
+    pnode->cb = std::move(cb);
+    TimerId id(pnode);
+
+    if (m_ploop->isEventLoopThread())
+    {
+        insert(std::move(pnode));
+    }
+    else // 堆只在I/O线程中操作，其他线程通过任务队列交给I/O线程
+    {
+        m_ploop->addTask([this, pnode]()
+                         { insert(pnode); });
+    }
+
+    return id;
+}
+
+// 取消定时器，可以在任意线程调用
+void TimerQueue::cancel(const TimerId &id)
+{
+    auto pnode = id.m_pnode.lock();
+    if (!pnode) // 定时器已经到期或被取消，节点已经释放
+    {
+        return;
+    }
+
+    if (m_ploop->isEventLoopThread())
+    {
+        remove(pnode);
+    }
+    else
+    {
+        m_ploop->addTask([this, pnode]()
+                         { remove(pnode); });
+    }
+}
+
+// 返回当前还未到期的定时器个数
+size_t TimerQueue::size() const
+{
+    return m_heap.size();
+}
+
+// 在I/O线程中把定时器放入堆中
+void TimerQueue::insert(std::shared_ptr<TimerNode> pnode)
+{
+    if (pnode->cancelled)
+    {
+        return;
+    }
+
+    pnode->sequence = m_sequence++;
+    push(std::move(pnode));
+
+    // 新的定时器成为堆顶，并且比 timerfd 当前的到期时间更早，才需要重新设置 timerfd
+    if (!m_isarmed || m_heap[0]->when < m_armed)
+    {
+        rearm();
+    }
+}
+
+// 在I/O线程中把定时器从堆中移除
+void TimerQueue::remove(const std::shared_ptr<TimerNode> &pnode)
+{
+    pnode->cancelled = true; // 正在执行的重复定时器在回调里取消自己时，不再放回堆中
+
+    if (pnode->heapindex != kNotInHeap)
+    {
+        pop(pnode->heapindex);
+    }
+
+    // 不重新设置 timerfd：即使移除的是堆顶，timerfd 提前响一次也只是空跑一轮
+}
+
+// timerfd 可读时的回调函数，执行所有到期的定时器
+void TimerQueue::handleRead()
+{
+    m_timer.wait();
+    m_isarmed = false;
+
+    TimePoint now = std::chrono::steady_clock::now();
+    while (!m_heap.empty() && m_heap[0]->when <= now)
+    {
+        m_expired.push_back(pop(0));
+    }
+
+    for (auto &pnode : m_expired)
+    {
+        if (pnode->cancelled) // 被本轮先执行的回调取消
+        {
+            continue;
+        }
+
+        pnode->cb();
+
+        // 重复的定时器，如果没有在回调里被取消，就计算下一次的到期时间放回堆中
+        if (pnode->interval.count() > 0 && !pnode->cancelled)
+        {
+            pnode->when = now + pnode->interval;
+            pnode->sequence = m_sequence++;
+            push(std::move(pnode));
+        }
+    }
+    m_expired.clear();
+
+    rearm();
+}
+
+// 让 timerfd 在堆顶定时器到期时响
+void TimerQueue::rearm()
+{
+    if (m_heap.empty())
+    {
+        return;
+    }
+
+    // timerfd 的首次超时时间为0表示关闭闹钟，已经到期的定时器至少等待1微秒
+    auto delay = m_heap[0]->when - std::chrono::steady_clock::now();
+    delay = std::max<std::chrono::steady_clock::duration>(delay, std::chrono::microseconds(1));
+
+    m_timer.settime(std::chrono::duration_cast<std::chrono::nanoseconds>(delay));
+    m_armed = m_heap[0]->when;
+    m_isarmed = true;
+}
+
+// 入堆
+void TimerQueue::push(std::shared_ptr<TimerNode> pnode)
+{
+    pnode->heapindex = m_heap.size();
+    m_heap.push_back(std::move(pnode));
+    siftup(m_heap.size() - 1);
+}
+
+// 取出堆中下标为index的定时器
+std::shared_ptr<TimerNode> TimerQueue::pop(size_t index)
+{
+    size_t last = m_heap.size() - 1;
+    if (index != last)
+    {
+        swapnode(index, last);
+    }
+
+    std::shared_ptr<TimerNode> pnode = std::move(m_heap.back());
+    m_heap.pop_back();
+    pnode->heapindex = kNotInHeap;
+
+    if (index < m_heap.size()) // 原来的最后一个节点换到了 index，需要重新调整位置
+    {
+        siftup(index);
+        siftdown(index);
+    }
+
+    return pnode;
+}
+
+void TimerQueue::siftup(size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (!before(index, parent))
+        {
+            break;
+        }
+        swapnode(index, parent);
+        index = parent;
+    }
+}
+
+void TimerQueue::siftdown(size_t index)
+{
+    size_t n = m_heap.size();
+    while (true)
+    {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < n && before(left, smallest))
+        {
+            smallest = left;
+        }
+        if (right < n && before(right, smallest))
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            break;
+        }
+        swapnode(index, smallest);
+        index = smallest;
+    }
+}
+
+// 堆中下标为a的定时器是否比下标为b的先到期
+bool TimerQueue::before(size_t a, size_t b) const
+{
+    const TimerNode &x = *m_heap[a];
+    const TimerNode &y = *m_heap[b];
+    return x.when < y.when || (x.when == y.when && x.sequence < y.sequence);
+}
+
+void TimerQueue::swapnode(size_t a, size_t b)
+{
+    std::swap(m_heap[a], m_heap[b]);
+    m_heap[a]->heapindex = a;
+    m_heap[b]->heapindex = b;
+}
\ No newline at end of file
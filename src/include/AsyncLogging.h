@@ -1,59 +1,65 @@
 #pragma once
 
+#include "LogFile.h"
+
 #include <memory>
 #include <string>
 #include <vector>
 #include <thread>
+#include <mutex>
 #include <atomic>
 #include <condition_variable>
 #include <cstring>
-#include <cassert>
 #include <iostream>
 
-struct LogBuffer // 辅助类，表示日志缓冲区
+// 每个写日志的线程独占的环形缓冲区，单生产者（写日志的线程）单消费者（日志线程），无锁。
+// 写下标和读下标都是单调递增的字节数，对容量取模得到在环里的位置
+struct LogRing
 {
-    char data[4 * 1000 * 1000];
-    uint32_t cur;
-    LogBuffer()
-    {
-        reset();
-    }
-    void reset()
-    {
-        memset(data, 0, sizeof(data));
-        cur = 0;
-    }
-
-    size_t available() const { return sizeof(data) - cur; }
-
-    void append(const char* logData, int len)
-    {
-        assert(available() >= len);
-        memcpy(data+cur, logData, len);
-        cur += len;
-    }
+    static const size_t kCapacity = 1 << 20; // 每个线程 1MB，容量必须是2的幂
+
+    LogRing();
+
+    // 写入一条日志，空间不够时丢弃整条日志并计数，返回是否写入。只由所属线程调用，不会阻塞
+    bool push(const char* logData, size_t len);
+
+    // 已经写入、还没被日志线程取走的字节数
+    size_t size() const;
+
+    std::unique_ptr<char[]> data;           // 环形缓冲区，不清零，由写日志的线程首次访问
+    std::atomic<uint64_t> writeIndex{0};    // 写下标，只由所属线程修改
+    std::atomic<uint64_t> readIndex{0};     // 读下标，只由日志线程修改
+    std::atomic<uint64_t> dropped{0};       // 因为空间不够丢弃的日志条数，日志线程取走后清零
+    std::atomic<bool> closed{false};        // 所属线程已经退出，日志线程取完剩余的日志后删除
+    long tid = 0;                           // 所属线程的ID，报告丢弃的日志时使用
 };
 
 class AsyncLogging
 {
 public:
-    using BufferPtr = std::unique_ptr<LogBuffer>;
-
     static AsyncLogging* getInstance(uint32_t flushInterval = 3);
 
     ~AsyncLogging();
 
     void start(); // 启动异步日志
 
-    void stop(); // 关闭异步日志
+    void stop(); // 关闭异步日志，先把所有线程里剩余的日志落盘
 
-    void Append(const char *logData, uint32_t len); // 记录日志
+    // 记录日志。写入当前线程自己的环形缓冲区，不加锁、不阻塞；缓冲区满时丢弃这条日志并计数
+    void Append(const char *logData, uint32_t len);
 
     void ThreadFunc(); // 日志线程运行的函数，负责日志落盘
 
     void setOutput(std::ostream* os);// 设置日志的输出方式，磁盘输出还是终端控制台输出
 
-    static bool exist; // 标志是否存在 AsyncLogging 类的单例对象
+    // 日志写到以 basename 命名的文件，由日志线程直接 writev 到文件描述符，按大小和日期滚动，每隔 fsyncInterval 秒落盘一次，
+    // 参数含义见 LogFile。二进制格式下每个文件的开头都带上调用点定义，可以单独用 logdecoder 还原。设置之后优先于 setOutput 指定的输出流；basename 为空表示不再写文件。可以在任意线程调用，打开文件失败时返回 false
+    bool setLogFile(const std::string& basename, size_t rollSize = LogFile::kDefaultRollSize, int fsyncInterval = 3);
+
+    // 启动以来因为缓冲区满而丢弃的日志条数，可以在任意线程调用
+    uint64_t droppedCount() const;
+
+    static std::atomic<bool> exist; // 标志 AsyncLogging 类的单例对象是否存在并且可以使用
 
 private:
     AsyncLogging(uint32_t flushInterval);
@@ -63,16 +69,30 @@ private:
     AsyncLogging& operator()(const AsyncLogging&) = delete;
     AsyncLogging& operator()(const AsyncLogging&&) = delete;
 
+    // 获取当前线程的环形缓冲区，线程第一次写日志时创建并登记
+    LogRing* localRing();
+
+    // 把所有环形缓冲区里的日志一次写到日志文件或者 m_output，报告丢弃的条数，删除已经退出并且取空了的线程的缓冲区。只由日志线程调用
+    bool drain();
+
+    std::vector<std::shared_ptr<LogRing>> m_rings; // 所有线程的环形缓冲区
+    std::mutex m_ringsmtx; // 保护 m_rings 和 m_file，只在线程第一次写日志、设置日志文件和日志线程遍历时加锁，不在写日志的路径上
 
-    BufferPtr m_currentBuffer;        // 当前正在使用的缓冲区
-    BufferPtr m_nextBuffer;           // 备胎缓冲区
-    std::vector<BufferPtr> m_buffers; // 缓冲队列，里面存放的是指向Buffer的指针
+    std::shared_ptr<LogFile> m_file; // 日志文件，为空时写到 m_output
+    LogFile m_stderr;                // m_output 是 std::cerr 时直接写标准错误的文件描述符
+    std::vector<struct iovec> m_iov; // 每轮要写出的数据段，只由日志线程使用，复用内存
+    std::string m_binsites;          // 二进制格式下这一轮新登记的调用点定义
+    std::string m_bindrop;           // 二进制格式下丢弃日志的报告
+    size_t m_siteswritten = 0;       // 二进制格式下已经写出定义的调用点个数
+    time_t m_lastdropreport = 0;     // 上一次在标准错误上提示丢弃日志的时间
 
     uint32_t m_flushInterval; // 刷新时间，默认3s
-    std::ostream* m_output;  // 日志最终的输出位置，磁盘或是终端控制台
+    std::atomic<std::ostream*> m_output;  // 日志最终的输出位置，磁盘或是终端控制台
+    std::atomic<uint64_t> m_dropped; // 启动以来丢弃的日志总条数
 
     std::thread m_thread; // 日志线程
-    std::mutex m_mtx;
+    std::mutex m_mtx;     // 只配合条件变量让日志线程睡眠，写日志的线程不会加这把锁
     std::condition_variable m_cond;
     std::atomic<bool> m_running;
+    std::atomic<bool> m_wakeup; // 是否已经有写日志的线程唤醒过日志线程，避免重复唤醒
 };
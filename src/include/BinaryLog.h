@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Log.h"
+
+#include <cstdint>
+#include <string>
+
+// 二进制日志的格式和调用点登记表。
+// 文件由一条条记录组成，每条记录以 RecordHeader 开头，size 是包括记录头在内的整条记录的字节数，整数都是本机字节序。
+// tag 小于 kMaxSiteId 时是一条日志，tag 就是调用点编号；其他 tag 见下面的常量。
+// 每个文件的开头是一条 kStartTag 记录和当时已经登记的全部调用点，之后新登记的调用点在用到它的日志之前写出，
+// 所以每个文件都可以单独还原；同一个文件被多个进程先后追加写入时，每个进程都以 kStartTag 开始，调用点编号从这里重新算起
+class BinaryLog
+{
+public:
+    static const uint32_t kStartTag = 0xFFFFFFFF; // 开始记录：魔数和进程ID
+    static const uint32_t kSiteTag = 0xFFFFFFFE;  // 调用点定义：编号、级别、行号、文件名、函数名
+    static const uint32_t kDropTag = 0xFFFFFFFD;  // 丢弃日志的报告：条数、线程数、时间
+    static const uint32_t kMaxSiteId = 0xFFFFFF00; // 调用点编号的上限
+
+    static constexpr char kMagic[8] = {'R', 'L', 'O', 'G', 'B', 'I', 'N', '1'};
+
+    // 参数的类型，每个参数是一个字节的类型加上原始字节
+    enum ArgType : uint8_t
+    {
+        kString = 's',  // uint32_t 长度加上字符串的内容
+        kInt = 'i',     // int64_t
+        kUint = 'u',    // uint64_t
+        kDouble = 'd',  // double
+        kPointer = 'p'  // uint64_t
+    };
+
+    struct RecordHeader
+    {
+        uint32_t size;
+        uint32_t tag;
+    };
+
+    // 日志记录的头，后面紧跟着参数
+    struct EventHeader
+    {
+        uint32_t size;
+        uint32_t site;   // 调用点编号
+        int64_t time;    // CLOCK_REALTIME，纳秒
+        uint32_t tid;    // 线程ID
+        uint32_t reserved;
+    };
+
+    struct StartRecord
+    {
+        uint32_t size;
+        uint32_t tag;
+        char magic[8];
+        int32_t pid;
+        uint32_t reserved;
+    };
+
+    // 调用点定义，后面紧跟着文件名和函数名，不以 '\0' 结尾
+    struct SiteRecord
+    {
+        uint32_t size;
+        uint32_t tag;
+        uint32_t id;
+        int32_t level;
+        int32_t line;
+        uint16_t filelen;
+        uint16_t funclen;
+    };
+
+    struct DropRecord
+    {
+        uint32_t size;
+        uint32_t tag;
+        uint64_t count;   // 丢弃的日志条数
+        uint64_t threads; // 丢弃过日志的线程数
+        int64_t time;     // CLOCK_REALTIME，纳秒
+    };
+
+    // 获取调用点的编号，第一次调用时登记并分配编号，之后只是一次原子变量的读取。可以在任意线程调用
+    static uint32_t siteId(const LogSite& site)
+    {
+        uint32_t id = site.id.load(std::memory_order_acquire);
+        return id != 0 ? id : registerSite(site);
+    }
+
+    // 已经登记的调用点个数，编号是 1 到 siteCount()
+    static size_t siteCount();
+
+    // 把开始记录追加到 out
+    static void appendStart(std::string& out);
+
+    // 把编号大于 from 的调用点定义追加到 out，返回写到的最大编号
+    static size_t appendSites(std::string& out, size_t from);
+
+    // 把丢弃日志的报告追加到 out
+    static void appendDrop(std::string& out, uint64_t count, uint64_t threads);
+
+private:
+    // 登记调用点并分配编号
+    static uint32_t registerSite(const LogSite& site);
+};
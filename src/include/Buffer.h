@@ -17,11 +17,18 @@
 class Buffer
 {
 public:
-    static const size_t kCheapPrepend = 8;   // 8字节前缀区域
-    static const size_t kInitialSize = 1024; // 缓冲区初始大小为1024字节
+    // constexpr 静态成员在 C++17 里是内联变量，传给 std::min/std::max 这类按引用取参数的函数时不需要类外定义
+    static constexpr size_t kCheapPrepend = 8;   // 8字节前缀区域
+    static constexpr size_t kInitialSize = 1024; // 缓冲区初始大小为1024字节
+    static constexpr size_t kMinReadHint = 64;   // 预估单次读取量的下限，一直只读到很少数据时也不会缩到没有意义的大小
+    static constexpr size_t kMaxReadHint = 65536; // 预估单次读取量的上限
 
     explicit Buffer(size_t initialSize = kInitialSize);
     ~Buffer() = default;
+    Buffer(const Buffer&) = default;
+    Buffer& operator=(const Buffer&) = default;
+    Buffer(Buffer&& other) noexcept;            // 接管other的底层内存，不拷贝数据，other变为空缓冲区
+    Buffer& operator=(Buffer&& other) noexcept; // 接管other的底层内存，不拷贝数据，other变为空缓冲区
 
     size_t readableBytes() const;             // 获取当前可读的数据量
     size_t writableBytes() const;             // 获取当前写的数据量
@@ -34,10 +41,12 @@ public:
     std::string retrieveAllAsString();        //消费所有的可读数据，并转换为string返回
     void append(const char* data, size_t len);// 将长度为len的data尾插到m_buffer的写下标之后
     void append(const void* data, size_t len);// 将长度为len的data尾插到m_buffer的写下标之后
+    void prepend(const void* data, size_t len);// 将长度为len的data插到可读数据之前，占用前缀区域，len 不能超过 prependableBytes()
     void ensureWriteableBytes(size_t len);    // 确保缓冲区里能写下len长度的数据
     char* beginWrite();                       // 获取写下标的位置
     const char* beginWrite() const;           // 获取写下标的位置
-    size_t readFd(int fd, int* savedError);   // 从内核缓冲区读取数据
+    size_t readFd(int fd, int* savedError, char* extrabuf, size_t extralen); // 从内核缓冲区读取数据，放不下的部分先读到 extrabuf 里
+    void shrink();                            // 没有可读数据时，把底层内存和预估的读取量缩回初始大小
 
 
 private:
@@ -49,4 +58,5 @@ private:
     std::vector<char> m_buffer;
     size_t m_readerIndex; // 读下标，指向首个未读数据
     size_t m_writerIndex; // 写下标，指向首个待写位置
+    size_t m_readhint;    // 根据最近几次读取的数据量预估的单次读取量，读之前先保证有这么多可写空间
 };
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Buffer.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+// 文件数据段：文件里从 offset 开始、长度为 length 的区域，析构时关闭 fd
+struct FileRegion
+{
+    FileRegion(int fd, off_t offset, size_t length) : fd(fd), offset(offset), length(length) {}
+    ~FileRegion();
+    FileRegion(const FileRegion&) = delete;
+    FileRegion& operator=(const FileRegion&) = delete;
+
+    int fd;        // 文件描述符，由 FileRegion 持有
+    off_t offset;  // 区域在文件里的起始位置
+    size_t length; // 区域的长度
+};
+
+// 链式发送缓冲区：由多个数据段组成的发送队列
+// 自有的字符串、共享的只读数据块、Buffer 都可以直接作为一个数据段排队，不需要拼接到一块连续内存里；
+// 发送时用 sendmsg 一次把最多 IOV_MAX 个数据段交给内核。文件数据段用 sendfile 发送，不经过用户态内存，
+// 和前后的内存数据段按排队的顺序发送
+class ChainBuffer
+{
+public:
+    static const size_t kCopyThreshold = 512; // 小于该长度的数据直接拷贝到队尾的Buffer段，避免产生大量很小的数据段
+
+    ChainBuffer() = default;
+    ~ChainBuffer() = default;
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+    ChainBuffer(ChainBuffer&&) = default;            // 接管数据段，数据的地址不变，内核引用着的内存不会被拷贝走
+    ChainBuffer& operator=(ChainBuffer&&) = default;
+
+    size_t readableBytes() const;                          // 获取待发送的数据量
+    bool empty() const;                                    // 是否没有待发送的数据
+    void append(const char* data, size_t len);             // 拷贝长度为len的data到队尾
+    void append(std::string&& str);                        // 接管字符串，作为一个数据段排队
+    void append(std::shared_ptr<const std::string> block); // 共享只读数据块，作为一个数据段排队
+    void append(Buffer&& buf);                             // 接管Buffer里的可读数据，作为一个数据段排队
+    void append(std::shared_ptr<FileRegion> file);         // 文件区域作为一个数据段排队
+    int peekiov(struct iovec* iov, int maxcnt) const;      // 用队首的内存数据段填充 iovec，遇到文件数据段为止，返回填充的个数
+    void retrieve(size_t len);                             // 消费len长度的数据
+    void retrieveAll();                                    // 消费所有数据
+    ssize_t writeFd(int fd, int* savedError);              // 把数据发送到内核缓冲区，返回发送的字节数
+
+    // 异步发送（io_uring 的 sendmsg 请求）：用队首的内存数据段填好 msghdr，flags 传出发送标志。
+    // 队首是文件数据段或者没有数据时返回 nullptr。请求完成之前，已经排队的数据段不会被修改、移动数据或释放，
+    // 新追加的数据总是放进新的数据段
+    const struct msghdr* beginsend(int* flags);
+
+    // 异步发送完成，消费发送出去的 len 字节，len 不大于0（出错）时不消费
+    void endsend(ssize_t len);
+
+    // 是否有还没完成的异步发送
+    bool sending() const;
+
+    // 设置零拷贝发送的阈值，0表示不启用（默认）。一次发送的数据量不小于阈值时带上 MSG_ZEROCOPY，套接字需要先设置 SO_ZEROCOPY
+    void setzerocopy(size_t threshold);
+
+    // 长度为len的数据是否要用零拷贝发送
+    bool iszerocopy(size_t len) const;
+
+    // 内核通知编号在 [lo, hi] 之间的零拷贝发送已经完成，释放不再被内核引用的数据段
+    void releasezerocopy(uint32_t lo, uint32_t hi);
+
+    // 读空套接字 fd 错误队列里的零拷贝完成通知，释放已经完成的数据段
+    void reapzerocopy(int fd);
+
+    // 连接关闭时调用：丢弃还没发送的数据，把内核可能还引用着的数据段连同发送编号一起转移出来
+    ChainBuffer detachpinned();
+
+    // 已经发送完、但还在等待零拷贝完成通知的数据段个数
+    size_t pinnedSegments() const;
+
+private:
+    using SharedBlock = std::shared_ptr<const std::string>;
+    using SharedFile = std::shared_ptr<FileRegion>;
+
+    struct Segment
+    {
+        std::variant<Buffer, std::string, SharedBlock, SharedFile> data; // 数据段持有的数据
+        size_t offset = 0;                                     // 字符串、共享数据块和文件已经发送的字节数（Buffer自己记录读下标）
+        bool zerocopied = false;                               // 是否有数据用 MSG_ZEROCOPY 发送过，内核可能还引用着这块内存
+        uint32_t zcid = 0;                                     // 最后一次引用该数据段的零拷贝发送的编号
+
+        const char* peek() const;   // 未发送数据的首地址，文件数据段没有
+        size_t size() const;        // 未发送的数据量
+        void retrieve(size_t len);  // 消费len长度的数据
+        bool isfile() const;        // 是否为文件数据段
+    };
+
+    void popfront(); // 移除队首已经发送完的数据段
+    ssize_t sendfilehead(int fd, const Segment& seg, int* savedError); // 用 sendfile 发送队首的文件数据段
+    void markzerocopy(size_t len, uint32_t id); // 把队首len字节所在的数据段标记为被编号为id的零拷贝发送引用
+    void pin(Segment&& seg);                    // 发送完的数据段等零拷贝完成通知之后再释放
+
+    std::vector<Segment> m_segments; // 数据段队列，[m_head, size()) 是还没发送完的数据段
+    size_t m_head = 0;               // 队首数据段的下标
+    size_t m_bytes = 0;              // 待发送的数据总量
+
+    size_t m_zerocopythreshold = 0;  // 零拷贝发送的阈值，0表示不启用
+    uint32_t m_zcnext = 0;           // 下一次零拷贝发送的编号，和内核的计数保持一致：每次成功的 MSG_ZEROCOPY 发送加一
+    uint32_t m_zcdone = 0;           // 编号小于它的零拷贝发送都已经完成（TCP 的完成通知按顺序到达）
+    std::deque<Segment> m_pinned;    // 已经发送完、还在等待完成通知的数据段，按 zcid 从小到大排列
+
+    size_t m_sendingsegs = 0;             // 异步发送期间，[m_head, m_head + m_sendingsegs) 是被请求引用着的数据段
+    std::vector<struct iovec> m_sendiov;  // 异步发送的 iovec，请求完成之前必须有效
+    struct msghdr m_sendmsg = {};         // 异步发送的 msghdr
+};
\ No newline at end of file
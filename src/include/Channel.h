@@ -22,7 +22,7 @@ public:
     int getfd() const;
 
     // 设置 m_isinepoll 成员
-    void setisinepoll();
+    void setisinepoll(bool inepoll = true);
 
     // 返回 m_isinepoll 成员
     bool getisinepoll() const;
@@ -33,6 +33,12 @@ public:
     // 返回 m_events 成员
     uint32_t getevents() const;
 
+    // 设置 m_regevents 成员，由 Poller 在注册成功之后调用
+    void setregevents(uint32_t ev);
+
+    // 返回 m_regevents 成员
+    uint32_t getregevents() const;
+
     // 设置 happenevents 成员
     void sethappenevents(uint32_t ev);
 
@@ -60,6 +66,18 @@ public:
     // 从事件循环中删除Channel
     void remove();
 
+    // 完成式 I/O（见 Poller::asyncio）：提交一个 recv 请求，完成时调用 m_recvdonecb
+    void submitrecv();
+
+    // 完成式 I/O：提交一个 sendmsg 请求，完成时调用 m_senddonecb。keepalive 持有 msg 引用的数据，请求完成之后才释放
+    void submitsendmsg(const struct msghdr* msg, int flags, std::shared_ptr<void> keepalive);
+
+    // 设置 recv 请求的结果，由 Poller 在返回 kRecvDone 事件之前调用。data 是读到的数据，res 是读到的字节数或者负的错误码
+    void setrecvresult(const char* data, ssize_t res);
+
+    // 设置 sendmsg 请求的结果，由 Poller 在返回 kSendDone 事件之前调用。res 是发送的字节数或者负的错误码
+    void setsendresult(ssize_t res);
+
     // 处理 epoll监视到已经发生的事件
     void handleevents();
 
@@ -72,13 +90,29 @@ public:
     // 设置 m_writeeventcb
     void setwriteeventcb(const std::function<void()>& func);
 
+    // 设置 m_erroreventcb
+    void seterroreventcb(const std::function<void()>& func);
+
+    // 设置 m_recvdonecb
+    void setrecvdonecb(const std::function<void(const char*, ssize_t)>& func);
+
+    // 设置 m_senddonecb
+    void setsenddonecb(const std::function<void(ssize_t)>& func);
+
 private:
     std::shared_ptr<Socket> m_psocket;          // 每一个Channel对象唯一对应一个Socket对象
     EventLoop* m_pelp;                          // 每一个Channel对象唯一对应一个EventLoop对象，但是每一个EventLoop对象对应多个Channel对象
     bool m_isinepoll = false;                   // 记录当前Channel对象是否加入到了Epoll对象的监测中
     uint32_t m_events = 0;                      // 需要监视的事件
+    uint32_t m_regevents = 0;                   // 已经注册到epoll里的事件，和m_events相同时不需要再调用epoll_ctl
     uint32_t m_happenevents = 0;                // epoll监视到已经发生的事件
     std::function<void()> m_readeventcb;        // epoll监视到的EPOLLIN类型的事件的回调函数
     std::function<void()> m_closeconnectioncb;  // 析构Connection对象的回调函数
     std::function<void()> m_writeeventcb;       // epoll监视到EPOLLOUT类型的事件的回调函数
+    std::function<void()> m_erroreventcb;       // epoll监视到EPOLLERR类型的事件的回调函数，例如套接字错误队列里有零拷贝发送的完成通知
+    std::function<void(const char*, ssize_t)> m_recvdonecb; // 提交的 recv 请求完成的回调函数
+    std::function<void(ssize_t)> m_senddonecb;  // 提交的 sendmsg 请求完成的回调函数
+    const char* m_recvdata = nullptr;           // recv 请求读到的数据，只在回调里有效
+    ssize_t m_recvres = 0;                      // recv 请求的结果
+    ssize_t m_sendres = 0;                      // sendmsg 请求的结果
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "EventLoop.h"
 #include "Buffer.h"
+#include "ChainBuffer.h"
 #include "TimesTamp.h"
 
 #include <memory>
@@ -35,35 +36,157 @@ public:
     // 处理 已存在的TCP连接的客户端I/O 的回调函数
     void onmessage();
 
-    // 将数据放到Connection对象的写缓冲区里，并注册写事件
+    // 下面的 send 可以在任意线程调用。数据先放进写缓冲区，连接加入事件循环的待发送列表，
+    // 本轮事件循环的末尾把这一轮里所有的回复合并成一次 sendmsg 发送；
+    // 在工作线程中调用时，数据的所有权随任务移动到I/O线程，不产生额外的拷贝
+
+    // 发送msg，工作线程调用时拷贝一次
     void send(const std::string& msg);
 
+    // 发送msg，接管字符串，不拷贝
+    void send(std::string&& msg);
+
+    // 发送长度为len的data，工作线程调用时拷贝一次
+    void send(const void* data, size_t len);
+
+    // 发送buf里的可读数据，接管Buffer，不拷贝
+    void send(Buffer&& buf);
+
+    // 发送共享的只读数据块，多个连接可以发送同一块数据，不拷贝
+    void send(std::shared_ptr<const std::string> block);
+
+    // 发送文件 fd 里从 offset 开始、长度为 length 的数据。由写事件驱动 sendfile 发送，文件内容不经过用户态内存；
+    // 和之前 send 的数据按调用顺序发送，全部发完后调用 m_sendcompletecb。内部复制了一份 fd，调用者可以立即关闭自己的 fd。
+    // 可以在任意线程调用，复制 fd 失败时返回 false
+    bool sendFile(int fd, off_t offset, size_t length);
+
     // 将 Connection 写缓冲区里的数据发送到内核的写缓冲区
     void sendto();
 
+    // 发送本轮事件循环里排队的数据，由事件循环在每轮末尾调用
+    void flush();
+
+    // 开启零拷贝发送：一次发送的数据量不小于 threshold 字节时使用 MSG_ZEROCOPY，数据段等内核的完成通知到达之后才释放；
+    // 连接关闭时还没收到通知的数据段连同套接字交给事件循环继续等待，见 EventLoop::lingerZerocopy。
+    // threshold 为0表示关闭。适合几百KB以上的回复；小数据零拷贝的开销比拷贝更大。可以在任意线程调用，
+    // 设置 SO_ZEROCOPY 失败、或者连接使用完成式 I/O（见 Poller::asyncio）时返回 false
+    bool setzerocopy(size_t threshold);
+
+    // 处理套接字错误队列里的消息，释放零拷贝发送完成的数据段
+    void onerror();
+
+    // 设置写缓冲区的高、低水位线（字节），high 为0表示不启用（默认）。
+    // 写缓冲区积压到 high 时暂停读这条连接并调用 m_highwatermarkcb，发送到不超过 low 时恢复读并调用 m_lowwatermarkcb，
+    // 对端读得慢时不会因为一直收请求、一直攒回复而无限占用内存。可以在任意线程调用
+    void setwatermark(size_t high, size_t low);
+
+    // 设置读缓冲区的上限（字节），0表示不限制（默认）。读缓冲区达到上限时先交给 m_handlemessagecb 处理，
+    // 处理之后仍然达到上限（单条消息超过上限）则断开连接。可以在任意线程调用
+    void setinputlimit(size_t limit);
+
+    // 设置 m_highwatermarkcb，在I/O线程中调用，参数是当时写缓冲区里的字节数
+    void sethighwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func);
+
+    // 设置 m_lowwatermarkcb，在I/O线程中调用，参数是当时写缓冲区里的字节数
+    void setlowwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func);
+
     // 获取 通信套接字fd
     int fd() const;
 
-    // 将Connection对象的Channel 添加到事件循环中，让epoll监听它的读事件
+    // 获取 Connection 所属的事件循环，可以用来在该连接的I/O线程上设置定时器
+    EventLoop* getloop() const;
+
+    // 将Connection对象的Channel 添加到事件循环中，让epoll监听它的读事件；完成模式下提交第一个 recv 请求
     void addToEpoll();
 
+    // 将Connection对象的Channel从事件循环中移除，只能在I/O线程中调用。事件循环释放连接之前调用，
+    // 工作线程之后才释放最后一个引用时，析构函数不会再跨线程修改 Poller。还没发送的数据被丢弃，
+    // 等待零拷贝完成通知的数据段交给事件循环；还没完成的 sendmsg 请求持有着连接，数据随连接一起释放
+    void removeFromLoop();
+
+    // 消息交给工作线程处理之前调用 beginreply，处理完、回复都 send 之后调用 endreply，可以在任意线程调用。
+    // 对端关闭写端时，连接等写缓冲区发空、所有 beginreply 都有对应的 endreply 之后才关闭，工作线程的回复不会被丢弃
+    void beginreply();
+    void endreply();
+
     // 判断当前连接是否超时
     bool isTimeOut(time_t interval);
 
+    // 连接已经空闲 interval 秒以上时释放读缓冲区扩容占用的内存，返回连接是否空闲。只能在I/O线程中调用
+    bool shrinkIfIdle(time_t interval);
+
 
 private:
     std::shared_ptr<Socket> m_psocket;
     EventLoop* m_ploop;
     std::shared_ptr<Channel> m_pchannel;
     Buffer m_inputbuf; // 接收缓冲区
-    Buffer m_outputbuf; // 发送缓冲区
+    ChainBuffer m_outputbuf; // 发送缓冲区，由多个数据段组成，发送时一次 sendmsg 聚合发送
     std::atomic<bool> m_disconnect; // 记录当前Connection连接是否断开
     TimesTamp m_lasttime; // 时间戳对象
     bool m_istimeout = false; // 记录当前Connection连接是否超时
+    bool m_flushqueued = false; // 是否已经在事件循环的待发送列表里
+    size_t m_highwatermark = 0; // 写缓冲区的高水位线，0表示不启用
+    size_t m_lowwatermark = 0; // 写缓冲区的低水位线
+    size_t m_inputlimit = 0; // 读缓冲区的上限，0表示不限制
+    bool m_abovehighwater = false; // 写缓冲区积压到高水位线之后、回落到低水位线之前为true，期间暂停读
+    const bool m_asyncio;          // 是否使用完成式 I/O：recv/sendmsg 作为请求提交给 io_uring，见 Poller::asyncio
+    bool m_reading = false;        // 完成模式下是否要读，为false时 recv 请求完成之后不再提交
+    bool m_recving = false;        // 完成模式下是否有一个还没完成的 recv 请求
+    std::atomic<bool> m_peerclosed{false}; // 对端已经关闭写端，不再读，回复发完之后关闭连接
+    std::atomic<int> m_pendingreplies{0};  // 交给工作线程处理、还没有回复完的消息批数
+    std::atomic<int> m_queuedsends{0};     // 工作线程 send 的、还在任务队列里没有放进写缓冲区的数据个数
 
     std::function<void(std::shared_ptr<Connection>, Buffer*)> m_handlemessagecb; // 处理客户端发送过来的数据的回调函数
     std::function<void(std::shared_ptr<Connection>)> m_sendcompletecb; // 当数据发送给客户端后的回调函数
+    std::function<void(std::shared_ptr<Connection>, size_t)> m_highwatermarkcb; // 写缓冲区积压到高水位线时的回调函数
+    std::function<void(std::shared_ptr<Connection>, size_t)> m_lowwatermarkcb; // 写缓冲区回落到低水位线时的回调函数
+
+    // 把连接加入事件循环的待发送列表，同一轮里多次 send 只加入一次
+    void queueflush();
+
+    // 写缓冲区积压到高水位线时暂停读，并通知上层，只在 flush 里调用
+    void checkhighwatermark();
+
+    // 写缓冲区回落到低水位线时恢复读，并通知上层
+    void checklowwatermark();
+
+    // 对端关闭写端之后，回复都发完、没有工作线程的回复在路上时关闭连接
+    void closeifdrained();
+
+    // 对端已经关闭写端：不再读，回复都发完之后关闭连接
+    void onpeerclosed();
+
+    // 开始读：就绪模式下注册读事件，完成模式下提交 recv 请求
+    void enablereading();
+
+    // 停止读：就绪模式下取消读事件，完成模式下不再提交新的 recv 请求
+    void disablereading();
+
+    // 完成式 I/O 下 recv 请求完成的回调函数，data 是读到的数据，res 是读到的字节数或者负的错误码
+    void onrecvdone(const char* data, ssize_t res);
+
+    // 完成模式下把写缓冲区队首的内存数据段作为 sendmsg 请求提交，队首是文件数据段时返回 false
+    bool submitsend();
+
+    // 完成式 I/O 下 sendmsg 请求完成的回调函数，res 是发送的字节数或者负的错误码
+    void onsenddone(ssize_t res);
+
+    // 读缓冲区是否达到上限
+    bool inputfull() const;
+
+    // 将长度为len的data写入Connection对象的写缓冲区，在I/O线程中调用
+    void writeTo(const char* data, size_t len);
+
+    // 将待发送的数据msg作为一个数据段放入Connection对象的写缓冲区，不拷贝，在I/O线程中调用
+    void writeTo(std::string&& msg);
+
+    // 将buf作为一个数据段放入Connection对象的写缓冲区，不拷贝，在I/O线程中调用
+    void writeTo(Buffer&& buf);
+
+    // 将共享的只读数据块作为一个数据段放入Connection对象的写缓冲区，不拷贝，在I/O线程中调用
+    void writeTo(std::shared_ptr<const std::string> block);
 
-    // 将待发送的数据msg写入Connection对象的写缓冲区
-    void writeTo(const std::string& msg);
+    // 将文件区域作为一个数据段放入Connection对象的写缓冲区，在I/O线程中调用
+    void writeTo(std::shared_ptr<FileRegion> file);
 };
\ No newline at end of file
@@ -1,26 +1,27 @@
 #pragma once
 
-#include "Channel.h"
 #include "Log.h"
+#include "Poller.h"
 
 #include <sys/epoll.h>
 #include <vector>
 
-using std::vector;
-class Channel; // 向前声明Channel类
-
-class Epoll
+// epoll 实现的 Poller，默认的 I/O 多路复用后端
+class Epoll : public Poller
 {
 public:
     Epoll();
 
-    ~Epoll();
+    ~Epoll() override;
 
     // 更新Channel对象的m_events属性
-    int updatechannel(Channel* pchannel);
+    int updatechannel(Channel* pchannel) override;
 
     // 将通信套接字从epoll中移除
-    int removechannel(Channel* pchannel);
+    int removechannel(Channel* pchannel) override;
+
+    // 等待事件发生，即 epollwait
+    EpollEvents poll(int& timeout) override;
 
     // 返回m_epfd
     int get() const;
@@ -29,12 +30,14 @@ public:
      * @brief 等待epoll所监听的事件的发生,设置超时时间
      * 
      * @param timeout 超时时间，传入传出参数。若传出值为-1，说明发生了错误，若传出值为0，说明没有发生错误。
-     * @return vector<struct epoll_event> 若为空，说明发生了错误或者超时时间到，需要结合timeout的传出值来区分。
+     * @return EpollEvents 就绪事件的视图，事件的 data.ptr 指向对应的Channel。若为空，说明发生了错误或者超时时间到，需要结合timeout的传出值来区分。
      */
-    vector<Channel*> epollwait(int& timeout);
+    EpollEvents epollwait(int& timeout);
 
-    static const int MAXEVENTS = 1024; // 单个epoll一次最多能处理的事件数量
+    static const int kInitEvents = 64;    // 事件数组的初始大小
+    static const int kMaxEvents = 65536;  // 事件数组自适应扩容的上限
 private:
     int m_epfd = -1;
-    struct epoll_event m_evs[MAXEVENTS]; // 存放epoll_wait返回的事件
+    std::vector<struct epoll_event> m_evs; // 存放epoll_wait返回的事件，上一轮被填满时自动扩容
+    int m_lastcnt = 0;                     // 上一轮epoll_wait返回的事件数量
 };
\ No newline at end of file
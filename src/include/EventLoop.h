@@ -1,30 +1,31 @@
 #pragma once
 
-#include "Epoll.h"
+#include "Poller.h"
 #include "EventFd.h"
-#include "Timer.h"
+#include "TimerQueue.h"
 #include "Connection.h"
+#include "MpscQueue.h"
+#include "Buffer.h"
+#include "ChainBuffer.h"
+#include "ObjectPool.h"
 
 #include <functional>
 #include <memory>
 #include <sys/syscall.h> // SYS_gettid
 #include <unistd.h>      // syscall 原型
-#include <queue>
-#include <functional>
-#include <mutex>
-#include <unordered_map>
-#include <list>
 #include <atomic>
-#include <unordered_set>
+#include <chrono>
+#include <vector>
 
 class Channel;
-class Epoll;
 class Connection;
+class Socket;
 
 class EventLoop
 {
 public:
-    EventLoop(bool ismainloop);
+    // type 指定事件循环使用的 I/O 多路复用后端
+    EventLoop(bool ismainloop, PollerType type = PollerType::Epoll);
     ~EventLoop();
     
     // 开启事件循环
@@ -39,32 +40,69 @@ public:
     // 将Channel从事件循环中删除
     void removeChannel(Channel* pchannel);
 
+    // I/O 多路复用后端是否支持完成式 I/O，见 Poller::asyncio
+    bool asyncio() const;
+
+    // 为Channel提交一个 recv 请求，只能在I/O线程中调用
+    void submitRecv(Channel* pchannel);
+
+    // 为Channel提交一个 sendmsg 请求，只能在I/O线程中调用
+    void submitSendmsg(Channel* pchannel, const struct msghdr* msg, int flags, std::shared_ptr<void> keepalive);
+
     // 设置 m_handletimeout
     void sethandletimeout(std::function<void(EventLoop*)> func);
 
+    // 设置空闲超时时间（毫秒）。事件循环连续 ms 毫秒没有事件发生时调用 m_handletimeout，小于0表示不启用（默认）
+    void setidletimeout(int ms);
+
+    // 设置忙轮询预算。大于0时，每轮事件循环先以0超时反复调用epoll_wait自旋budget时长，仍没有事件才阻塞等待，用CPU换取唤醒延迟
+    void setbusypoll(std::chrono::microseconds budget);
+
     // 判断当前线程是不是I/O线程，用于和工作线程区分
     bool isEventLoopThread();
 
-    // 将任务加入到任务队列中
+    // 将任务加入到任务队列中，只有事件循环阻塞在epoll_wait上时才通过eventfd唤醒它
     void addTask(std::function<void()> func);
 
     // 处理 eventfd 唤醒epoll_wait
     void handleWakeUp();
 
-    // 处理定时器事件
+    // 取出任务队列里的全部任务并执行，每轮事件循环都会调用
+    void doPendingTasks();
+
+    // 处理定时器事件，从事件循环每隔 m_evictinterval 调用一次，淘汰超时的连接，缩小空闲连接的读缓冲区
     void handleTimer(); 
 
-    // 有新的连接时，由 TcpServer 调用，往m_lruconnection和m_connectionmap里添加成员
+    // 在 when 时刻执行 cb，可以在任意线程调用
+    TimerId runAt(TimerQueue::TimePoint when, std::function<void()> cb);
+
+    // 在 delay 之后执行 cb，可以在任意线程调用
+    TimerId runAfter(std::chrono::nanoseconds delay, std::function<void()> cb);
+
+    // 每隔 interval 执行一次 cb，可以在任意线程调用
+    TimerId runEvery(std::chrono::nanoseconds interval, std::function<void()> cb);
+
+    // 取消定时器，可以在任意线程调用
+    void cancel(const TimerId& id);
+
+    // 有新的连接时，由 TcpServer 在I/O线程中调用，事件循环持有Connection对象，并把它放到活跃链表的头部
     void newConnection(std::shared_ptr<Connection> pConn);
 
-    // 当Connection连接有I/O事件发生时，由 Connection 调用此函数来“续命”，将Connection连接splice到链表头部
+    // 当Connection连接有I/O事件发生时，由 Connection 调用此函数来“续命”，将Connection连接移到活跃链表头部
     void updateConnection(int fd);
 
-    // 删除 m_lruconnection 里面超时的连接
+    // 把活跃链表尾部超时的连接加入延迟删除列表
     void removeTimeOutConnection(time_t interval);
 
-    // 设置m_timerCallback
-    void settimerCallback(std::function<void(int)> func);
+    // 从活跃链表尾部开始，释放空闲 interval 秒以上的连接的读缓冲区扩容占用的内存
+    void shrinkIdleConnections(time_t interval);
+
+    // 已经关闭的连接还有数据段在等零拷贝完成通知：关闭套接字的写端，保留套接字和数据段，
+    // 由定时器读取错误队列，全部完成（或者超过 m_timeout）之后再释放。只能在I/O线程中调用
+    void lingerZerocopy(std::shared_ptr<Socket> psocket, ChainBuffer pinned);
+
+    // 读取等待中的套接字的错误队列，释放已经全部完成或者超时的套接字和数据段
+    void reapLingering();
 
     // 设置 m_delayDeleteCallback
     void setdelayDeleteCallback(std::function<void(int)> func);
@@ -72,30 +110,85 @@ public:
     // 将Connection的fd添加到m_delayDeleteConnectionfd里
     void delayDelete(int fd);
 
-    // 删除m_delayDeleteConnectionfd里面所有的连接，并清空m_delayDeleteConnectionfd
+    // 释放m_delayDeleteConnectionfd里面所有的连接，并清空m_delayDeleteConnectionfd
     void deleteConnection();
 
+    // 把有待发送数据的连接加入待发送列表，只能在I/O线程中调用
+    void queueFlush(std::shared_ptr<Connection> pConn);
+
+    // 发送待发送列表里每个连接排队的数据，每个连接一次 sendmsg，并清空待发送列表。每轮事件循环的末尾调用
+    void flushPendingOutput();
+
+    // 获取当前事件循环持有的连接数，可以在任意线程调用
+    size_t connectionCount() const;
+
+    // 获取接收溢出区。同一个事件循环里的连接依次读取数据，共用这一块内存，只能在I/O线程中使用
+    char* scratch();
+
+    // 获取接收溢出区的大小
+    size_t scratchsize() const;
+
+    // 获取事件循环的内存池，用来分配该事件循环上的 Socket、Channel、Connection
+    const std::shared_ptr<ObjectPool>& objectpool() const;
+
 private:
-    std::unique_ptr<Epoll> m_pep; // 封装了Epoll
+    // 计算本轮epoll_wait的超时时间：阻塞到下一个真正的截止时间，没有截止时间则一直阻塞
+    int pollTimeout() const;
+
+    // 等待事件发生，开启忙轮询时先自旋再阻塞
+    EpollEvents poll(int& timeout);
+
+    std::unique_ptr<Poller> m_ppoller; // I/O 多路复用后端，epoll 或 io_uring
     std::atomic<bool> m_stop; // 事件循环停止的标志
     
     pthread_t m_threadid; // 当前事件循环所在的线程的线程ID
     bool m_ismmainloop; // 当前事件循环是 主事件循环(true)， 还是 从事件循环(false) 的表示
-    std::queue<std::function<void()>> m_taskqueue; // 任务队列，放工作线程传给I/O线程的send任务
-    std::mutex m_mtx;
+    MpscQueue<std::function<void()>> m_taskqueue; // 无锁任务队列，放工作线程传给I/O线程的send任务
+    std::atomic<bool> m_polling; // 事件循环是否即将或正在阻塞在epoll_wait上，addTask据此决定是否需要唤醒
     
     EventFd m_eventfd; // 封装了eventfd,用于唤醒事件循环
     std::unique_ptr<Channel> m_pwakechannel; // eventfd所对应的Channel
 
-    Timer m_timer; // 定时器对象
-    std::unique_ptr<Channel> m_ptimerchannel; // 定时器所对应的Channel
+    TimerQueue m_timerqueue; // 定时器队列，所有定时器共用一个timerfd
+    const std::chrono::seconds m_evictinterval{7}; // 检查超时连接的间隔
     const int m_timeout = 300; // 超时时间，默认300s。每隔300s，事件循环就被唤醒一次。
-
-    std::list<std::weak_ptr<Connection>> m_lruconnection; // 按活跃度排序的连接列表，头部是最近活跃的Connection连接
-    std::unordered_map<int, std::list<std::weak_ptr<Connection>>::iterator> m_connectionmap;  // 从 fd 快速定位到 list 中的节点
-    std::unordered_set<int> m_delayDeleteConnectionfd; // 记录了每轮事件循环后需要延迟删除的Connection连接的fd
+    std::atomic<int> m_idletimeout;       // 空闲超时时间（毫秒），小于0表示不启用
+    std::atomic<int64_t> m_busypollus;    // 忙轮询预算（微秒），0表示不启用
+
+    static const size_t kScratchSize = Buffer::kMaxReadHint; // 接收溢出区的大小
+    std::unique_ptr<char[]> m_scratch;    // 接收溢出区，在I/O线程里分配，不清零
+    std::shared_ptr<ObjectPool> m_objectpool; // 内存池，连接关闭后释放的对象留在本事件循环里复用
+
+    // 连接表里的一项，以连接的fd为下标。活跃链表直接串在连接表里（prev/next 也是fd），不需要额外分配链表节点
+    struct ConnectionSlot
+    {
+        std::shared_ptr<Connection> pconn; // 事件循环持有的Connection对象，为空表示该fd不属于本事件循环
+        int prev = -1;                     // 活跃链表中更活跃的一项
+        int next = -1;                     // 活跃链表中更不活跃的一项
+        bool closing = false;              // 是否已经加入了延迟删除列表
+    };
+
+    void linkfront(int fd); // 把连接放到活跃链表的头部
+    void unlink(int fd);    // 把连接从活跃链表中摘下
+
+    // 连接表和活跃链表只在I/O线程中访问，不需要加锁
+    std::vector<ConnectionSlot> m_connections; // 连接表，以fd为下标
+    int m_lruhead = -1;                        // 活跃链表头部，最近活跃的连接
+    int m_lrutail = -1;                        // 活跃链表尾部，最久没有活跃的连接
+    std::atomic<size_t> m_connectioncount;     // 连接数，供其他线程统计
+    std::vector<int> m_delayDeleteConnectionfd; // 记录了每轮事件循环后需要延迟删除的Connection连接的fd
+    std::vector<std::shared_ptr<Connection>> m_pendingflush; // 本轮事件循环里有数据要发送的连接
+    std::vector<std::shared_ptr<Connection>> m_flushing;     // 正在发送的连接，和 m_pendingflush 交换，复用两个 vector 的内存
+
+    // 已经关闭、还在等零拷贝完成通知的连接
+    struct Lingering
+    {
+        std::shared_ptr<Socket> psocket; // 保持打开，才能读取错误队列，fd 也不会被新连接复用
+        ChainBuffer pinned;              // 内核可能还引用着的数据段
+        time_t deadline;                 // 超过这个时间不再等待
+    };
+    std::vector<Lingering> m_lingering;
 
     std::function<void(EventLoop*)> m_handletimeout; // 回调函数， 处理事件循环发生超时
-    std::function<void(int)> m_timerCallback; // 回调函数，定时器触发后执行，调用cpServer类的removeTimeOutConnection函数，用来删除TcpServer管理的Connection连接
-    std::function<void(int)> m_delayDeleteCallback; // 回调函数，每轮事件循环后执行，调用TcpServer类的deleteconnection函数，用来删除TcpServer管理的Connection连接
+    std::function<void(int)> m_delayDeleteCallback; // 回调函数，每轮事件循环后执行，调用TcpServer类的deleteconnection函数，通知上层连接已经删除
 };
\ No newline at end of file
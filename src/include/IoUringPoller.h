@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Log.h"
+#include "Poller.h"
+
+#include <linux/io_uring.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// io_uring 实现的 Poller，直接使用系统调用，不依赖 liburing
+// 每个Channel对应一个一次性的 IORING_OP_POLL_ADD 请求：事件触发后请求自动失效，处理完事件后在下一轮等待之前重新提交。
+// 一轮事件循环里所有的 提交(poll-add/poll-remove) 和 等待 合并成一次 io_uring_enter；
+// 监视的事件没有变化时不提交任何请求，相当于省掉了 epoll_ctl(EPOLL_CTL_MOD)。
+// 请求的 user_data 是 fd<<32 | 请求类型<<30 | 代数，fd 的监视被修改或移除时代数加一，旧请求的完成事件会被识别出来丢弃。
+// 一次性的 poll 是水平触发语义，EPOLLET 被忽略；连接本来就读写到 EAGAIN 为止，语义上没有区别。
+// 内核支持 IORING_FEAT_FAST_POLL 和接收缓冲区环（5.19+）时还支持完成式 I/O（见 Poller::asyncio）：
+// 连接的 recv/sendmsg 也是请求，和 poll 请求一起在等待之前提交，一轮事件循环只有一次 io_uring_enter。
+// recv 请求不指定缓冲区，数据到达时内核才从注册的接收缓冲区环里取一块，空闲的连接不占用接收缓冲区；
+// 文件数据段仍然由写事件驱动同步 sendfile。
+// 所有成员函数都只能在所属事件循环的I/O线程中调用：提交队列和 m_fds 没有加锁（epoll_ctl 是线程安全的，这里不是）
+class IoUringPoller : public Poller
+{
+public:
+    static const unsigned kEntries = 1024;      // 提交队列的大小，完成队列是它的4倍
+    static const unsigned kRecvBufCount = 256;  // 接收缓冲区的个数，必须是2的幂
+    static const unsigned kRecvBufSize = 16384; // 每个接收缓冲区的大小，一个 recv 请求最多读这么多
+
+    IoUringPoller();
+    ~IoUringPoller() override;
+    IoUringPoller(const IoUringPoller&) = delete;
+    IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+    // io_uring 是否初始化成功。内核不支持 io_uring 或者不支持 IORING_FEAT_EXT_ARG 时返回 false
+    bool valid() const;
+
+    // 按照Channel的m_events属性添加或修改监视的事件，只记录下来，下一轮等待之前统一提交
+    int updatechannel(Channel* pchannel) override;
+
+    // 将Channel从监视中移除
+    int removechannel(Channel* pchannel) override;
+
+    // 提交本轮积累的请求，并等待事件发生
+    EpollEvents poll(int& timeout) override;
+
+    // 是否支持完成式 I/O
+    bool asyncio() const override;
+
+    // 为Channel提交一个 recv 请求，数据读进接收缓冲区环里的一块
+    void submitrecv(Channel* pchannel) override;
+
+    // 为Channel提交一个 sendmsg 请求，keepalive 持有到请求完成
+    void submitsendmsg(Channel* pchannel, const struct msghdr* msg, int flags, std::shared_ptr<void> keepalive) override;
+
+private:
+    struct FdState
+    {
+        Channel* pchannel = nullptr; // fd 对应的Channel，为空表示没有被监视
+        uint32_t mask = 0;           // 需要监视的事件
+        uint32_t armedmask = 0;      // 已经提交的 poll 请求监视的事件
+        uint32_t gen = 0;            // poll 请求的代数，写在请求的 user_data 里
+        uint32_t iogen = 0;          // recv/sendmsg 请求的代数，只在移除时加一，修改监视的事件不影响它们
+        bool armed = false;          // 是否有一个还没完成的 poll 请求
+        bool pending = false;        // 是否在 m_pendingfds 里，等待下一轮提交 poll 请求
+        bool recving = false;        // 是否有一个还没交给Channel的 recv 请求
+        bool recvwait = false;       // recv 请求因为接收缓冲区用完而失败，在 m_recvwaitfds 里等下一轮重新提交
+        std::shared_ptr<void> sendkeep; // 还没完成的 sendmsg 请求引用的数据，不为空表示有请求在进行
+    };
+
+    // user_data 里的请求类型
+    enum Op : uint64_t
+    {
+        kOpPoll = 0,
+        kOpRecv = 1,
+        kOpSend = 2,
+    };
+
+    static const uint64_t kIgnoreData = ~0ull; // poll-remove、取消请求的 user_data，它们的完成事件直接丢弃
+    static const uint32_t kGenMask = (1u << 30) - 1; // user_data 里代数占低30位
+    static const uint16_t kBufGroup = 0;       // 接收缓冲区环的组号
+
+    static uint64_t userdata(int fd, Op op, uint32_t gen); // 组合请求的 user_data
+
+    void release();                     // 解除映射并关闭 io_uring
+    FdState& state(int fd);             // 获取 fd 的状态，必要时扩容
+    void markpending(int fd);           // 让 fd 在下一轮等待之前提交 poll 请求
+    void arm(int fd);                   // 提交 poll-add 请求
+    void disarm(int fd);                // 提交 poll-remove 请求，让还没完成的 poll 请求失效
+    void preprecv(int fd);              // 提交 recv 请求
+    void cancel(uint64_t target);       // 提交取消请求，target 是要取消的请求的 user_data
+    bool setupbufring();                // 注册接收缓冲区环，失败时不支持完成式 I/O
+    void recyclebufs();                 // 把上一轮交给Channel的接收缓冲区放回环里
+    struct io_uring_sqe* getsqe();      // 获取一个空闲的提交队列项，提交队列满了先提交
+    int enter(unsigned submit, unsigned mincomplete, int timeout); // 调用 io_uring_enter 提交请求并等待
+    void reap();                        // 从完成队列里取出所有的完成事件
+
+    int m_ringfd = -1;
+
+    // 提交队列
+    void* m_sqptr = nullptr;
+    size_t m_sqsize = 0;
+    unsigned* m_sqhead = nullptr;
+    unsigned* m_sqtail = nullptr;
+    unsigned* m_sqmask = nullptr;
+    unsigned* m_sqarray = nullptr;
+    unsigned m_sqentries = 0;
+    struct io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqessize = 0;
+    unsigned m_sqlocaltail = 0; // 已经填好、还没有发布给内核的提交队列尾部
+    unsigned m_tosubmit = 0;    // 已经填好、还没有提交的请求个数
+
+    // 完成队列
+    void* m_cqptr = nullptr;
+    size_t m_cqsize = 0;
+    unsigned* m_cqhead = nullptr;
+    unsigned* m_cqtail = nullptr;
+    unsigned* m_cqmask = nullptr;
+    struct io_uring_cqe* m_cqes = nullptr;
+
+    std::vector<FdState> m_fds;           // 以fd为下标的状态表
+    std::vector<int> m_pendingfds;        // 下一轮等待之前需要提交 poll 请求的fd
+    std::vector<struct epoll_event> m_evs; // 本轮的就绪事件
+
+    // 接收缓冲区环：内核从环里取空闲的缓冲区，用完的缓冲区在下一轮等待之前放回去
+    bool m_asyncio = false;
+    struct io_uring_buf_ring* m_bufring = nullptr;
+    size_t m_bufringsize = 0;
+    char* m_bufbase = nullptr;            // kRecvBufCount 个接收缓冲区的连续内存
+    uint16_t m_buftail = 0;               // 环的尾部，放回缓冲区之后发布给内核
+    std::vector<uint16_t> m_usedbufs;     // 本轮交给Channel的接收缓冲区编号
+    std::vector<int> m_recvwaitfds;       // 接收缓冲区用完、等下一轮重新提交 recv 请求的fd
+    std::vector<std::shared_ptr<void>> m_done; // 本轮完成的 sendmsg 请求持有的对象，下一轮等待之前释放，不在取完成事件的过程中析构连接
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Buffer.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+class Connection;
+
+// 一次读取中解析出来的所有完整的帧，每一帧是一个不含长度头的消息体视图。
+// 视图默认直接指向连接的读缓冲区，只在回调返回之前有效；需要交给其他线程处理时调用 detach 转移所有权
+class FrameBatch
+{
+public:
+    using const_iterator = std::vector<std::string_view>::const_iterator;
+
+    FrameBatch() = default;
+    FrameBatch(const FrameBatch&) = delete;
+    FrameBatch& operator=(const FrameBatch&) = delete;
+
+    // 帧的个数
+    size_t size() const { return m_frames.size(); }
+    bool empty() const { return m_frames.empty(); }
+
+    // 第 i 帧的消息体
+    std::string_view operator[](size_t i) const { return m_frames[i]; }
+
+    const_iterator begin() const { return m_frames.begin(); }
+    const_iterator end() const { return m_frames.end(); }
+
+    // 把这批帧的所有权转移出来，不拷贝消息体：直接接管读缓冲区的底层内存，帧视图继续有效。
+    // 读缓冲区换成一块新的内存，只把末尾不完整的帧（最多一帧）拷贝回去。
+    // 只能在回调里调用一次，之后本对象为空
+    std::shared_ptr<FrameBatch> detach();
+
+private:
+    friend class LengthCodec;
+
+    Buffer* m_source = nullptr;             // 帧视图指向的读缓冲区，detach 之后为空
+    size_t m_consumed = 0;                  // 完整的帧（包括长度头）占用的字节数，回调返回后从读缓冲区消费掉
+    std::optional<Buffer> m_storage;        // detach 之后持有帧的数据
+    std::vector<std::string_view> m_frames; // 帧的消息体视图
+};
+
+// 长度前缀分帧的编解码器：每一帧是 固定宽度的长度头 + 消息体，长度头是消息体的字节数。
+// 解码直接在连接的读缓冲区上进行，一次读取得到的所有完整帧作为一批交给回调；编码时把长度头填进 Buffer 的前缀区域，整个 Buffer 移动给 Connection 发送
+class LengthCodec
+{
+public:
+    enum class Endian
+    {
+        Big,    // 网络字节序，默认
+        Little,
+    };
+
+    static const size_t kDefaultMaxFrame = 64 * 1024 * 1024; // 默认的最大消息体长度
+
+    // 收到一批完整的帧之后的回调函数，在I/O线程中调用
+    using FrameCallback = std::function<void(const std::shared_ptr<Connection>&, FrameBatch&)>;
+
+    // headerlen 是长度头的字节数，只能是 1、2、4、8
+    explicit LengthCodec(size_t headerlen = 4, Endian endian = Endian::Big, size_t maxframe = kDefaultMaxFrame);
+
+    // 设置 m_framecb
+    void setframecb(FrameCallback func);
+
+    // 从连接的读缓冲区里解析出所有完整的帧，交给 m_framecb，然后消费掉这些帧。
+    // 消息体超过最大长度时关闭连接。作为 TcpServer 的 handlemessage 回调使用
+    void onmessage(const std::shared_ptr<Connection>& pConn, Buffer* buf) const;
+
+    // 在 buf 的可读数据前面加上长度头，buf 的可读数据就是消息体。
+    // 消息体超过最大长度（对端会当作非法帧断开连接，也可能超出长度头能表示的范围）时不编码，返回false
+    bool encode(Buffer* buf) const;
+
+    // 把 buf 的可读数据作为消息体加上长度头，移动给连接发送，不拷贝。消息体超过最大长度时不发送，返回false
+    bool send(const std::shared_ptr<Connection>& pConn, Buffer&& buf) const;
+
+    // 拷贝一次消息体，加上长度头后发送。消息体超过最大长度时不发送，返回false
+    bool send(const std::shared_ptr<Connection>& pConn, std::string_view body) const;
+
+    // 长度头的字节数
+    size_t headerlen() const;
+
+private:
+    uint64_t readheader(const char* p) const;   // 解析长度头
+    void writeheader(char* p, uint64_t len) const; // 填写长度头
+
+    size_t m_headerlen;
+    Endian m_endian;
+    size_t m_maxframe;
+    FrameCallback m_framecb; // 收到一批完整的帧之后的回调函数
+};
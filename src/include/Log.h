@@ -1,12 +1,23 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <chrono>
+#include <cstdint>
 #include <ctime>
 #include <fstream>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 一条日志在栈上的一块固定大小的缓冲区里格式化：日志头（级别、线程ID、时间、位置）和 operator<< 的内容直接写进这块缓冲区，
+// 析构时整行交给异步日志的前端，不经过 std::ostringstream，也不分配内存。
+// 线程ID和精确到秒的时间字符串缓存在线程局部变量里，同一秒内只需要重新格式化微秒部分。
+// 二进制格式下不做任何文本格式化：只记录调用点编号、时间戳、线程ID和参数的原始字节，由 logdecoder 离线还原成文本
+struct LogSite;
 
 class Log
 {
@@ -19,13 +30,21 @@ public:
         error
     };
 
-    enum OutputTarget 
+    enum OutputTarget
     {
         CONSOLE,    // 输出到控制台
         FILE        // 输出到文件
     };
 
-    Log(Level lv, const char *file, int line, const char *func);
+    enum OutputFormat
+    {
+        TEXT,       // 文本格式，每条日志格式化成一行
+        BINARY      // 二进制格式，格式见 BinaryLog.h，只在使用异步日志时生效
+    };
+
+    static const size_t kLineSize = 4096; // 一条日志的最大长度（包括换行符），超出的部分被截断
+
+    explicit Log(const LogSite &site);
     Log(const Log&) = delete;
     Log(const Log&&) = delete;
     Log& operator()(const Log&) = delete;
@@ -33,11 +52,53 @@ public:
 
     ~Log(); // 触发析构函数的时候才输出日志内容
 
-    // 重载operator<<
+    // 重载operator<<：字符串、字符、整数、浮点数、指针直接格式化进缓冲区，二进制格式下直接记录原始字节；
+    // 其他类型借助 std::ostringstream 格式化成字符串
     template <class T>
     Log &operator<<(const T &t)
     {
-        os_ << t;
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, char>)
+        {
+            append(&t, 1);
+        }
+        else if constexpr (std::is_array_v<T>) // 字符数组（包括字符串字面量）
+        {
+            append(std::string_view(t));
+        }
+        else if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *>)
+        {
+            append(t ? std::string_view(t) : std::string_view("(null)"));
+        }
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        {
+            append(std::string_view(t));
+        }
+        else if constexpr (std::is_integral_v<U>) // bool 和 std::ostream 一样输出 1、0
+        {
+            if constexpr (std::is_signed_v<U>)
+            {
+                appendSigned(static_cast<long long>(t));
+            }
+            else
+            {
+                appendUnsigned(static_cast<unsigned long long>(t));
+            }
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            appendDouble(static_cast<double>(t));
+        }
+        else if constexpr (std::is_pointer_v<U>)
+        {
+            appendPointer(static_cast<const void *>(t));
+        }
+        else
+        {
+            std::ostringstream os;
+            os << t;
+            append(os.str());
+        }
         return *this;
     }
 
@@ -47,23 +108,92 @@ public:
     // 获取当前输出流
     static std::ostream& GetOutputStream();
 
-private:
+    // 设置输出格式，可以在任意线程调用。改成二进制格式应该在写第一条日志、设置日志文件之前，
+    // 同一个文件里混有文本和二进制日志时 logdecoder 无法还原
+    static void SetOutputFormat(OutputFormat format);
+
+    // 获取输出格式
+    static OutputFormat GetOutputFormat();
+
+    // 设置运行时的日志级别，低于 lv 的日志不再格式化和输出，可以在任意线程调用。默认 debug，全部输出
+    static void SetLevel(Level lv);
+
+    // 获取运行时的日志级别
+    static Level GetLevel();
+
+    // 级别为 lv 的日志是否需要输出，由 LOG 宏在构造 Log 对象之前调用，只是一次原子变量的读取和比较
+    static bool IsEnabled(Level lv)
+    {
+        return lv >= level_.load(std::memory_order_relaxed);
+    }
+
+    // 获取日志级别的名字，固定5个字符
     static const char *level2str(Level l);
-    std::ostringstream os_;
+
+private:
+
+    void append(std::string_view s);            // 追加字符串，放不下的部分截断
+    void append(const char *data, size_t len);  // 追加长度为 len 的数据，放不下的部分截断
+    void appendSigned(long long v);             // 追加有符号整数
+    void appendUnsigned(unsigned long long v);  // 追加无符号整数
+    void appendDouble(double v);                // 追加浮点数，格式和 std::ostream 的默认格式（%g）相同
+    void appendPointer(const void *p);          // 追加指针，十六进制
+    void appendArg(uint8_t type, const void *data, size_t len); // 二进制格式下追加一个参数：类型和原始字节，放不下时丢弃
+
+    char buf_[kLineSize]; // 日志行缓冲区，在栈上，留一个字节给换行符
+    size_t len_;          // 已经写入的长度
     Level lv_;
+    bool binary_;         // 这条日志是否以二进制格式记录
 
     static OutputTarget output_target_; // 静态成员变量，表示日志输出形式
     static std::ofstream log_file_; // 静态成员变量，表示记录日志的文件输出流
     static std::string output_file_name_; // 静态成员变量，表示记录日志的文件的名称
 
-    std::mutex m_mtx;
+    static std::mutex m_mtx; // 同步输出时保护输出流，所有日志共用
+    static std::atomic<int> level_; // 运行时的日志级别，低于它的日志被 LOG 宏跳过
+    static std::atomic<int> format_; // 输出格式
 };
 
-/* 
-    真正被用户用的宏 
+// 一条 LOG 语句的调用点：级别、文件、行号、函数名在编译期就确定，每条语句一个常量初始化的静态对象，不需要运行时初始化。
+// 二进制格式只记录调用点的编号，编号在这条语句第一次以二进制格式输出时分配，见 BinaryLog::registerSite
+struct LogSite
+{
+    Log::Level level;
+    const char *file;
+    int line;
+    const char *func;
+    mutable std::atomic<uint32_t> id{0}; // 调用点编号，0表示还没有分配
+};
+
+/*
+    编译期的最低日志级别：0 debug、1 info、2 warn、3 error，低于它的 LOG 语句在编译期就被整条删除。
+    可以用 -DLOG_MIN_LEVEL=N 指定；没有指定时，定义了 NDEBUG 的 release 构建去掉 debug 日志，其他构建全部保留
+*/
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+/*
+    真正被用户用的宏
     __FILE__: 当前源文件名
     __LINE__: 当前行号
     __func__: 当前函数名
     lv:debug、info、warn、error。
+    先判断级别再构造 Log 对象：级别不够时跳过整条语句，<< 右边的参数都不会求值，只有一次分支的开销；
+    低于 LOG_MIN_LEVEL 的级别条件在编译期就是 false，整条语句被编译器删除。
+    写成 if-else 的形式，LOG(lv) << ... 放在没有花括号的 if 里也不会和外层的 else 错配；
+    调用点对象声明在 if 的初始化语句里，__func__ 仍然是调用 LOG 的函数的名字
 */
-#define LOG(lv) Log(Log::lv, __FILE__, __LINE__, __func__)
\ No newline at end of file
+#define LOG(lv)                                                            \
+    if (!(Log::lv >= LOG_MIN_LEVEL && Log::IsEnabled(Log::lv)))           \
+    {                                                                      \
+    }                                                                      \
+    else if (static const LogSite log_site_{Log::lv, __FILE__, __LINE__, __func__}; false) \
+    {                                                                      \
+    }                                                                      \
+    else                                                                   \
+        Log{log_site_}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <ctime>
+#include <functional>
+#include <string>
+
+// 异步日志的落盘端：日志线程把所有线程攒下的日志用一次 writev 直接写到文件描述符，不经过 std::ostream。
+// 写到文件时按大小和日期滚动：文件名是 "yyyy-mm-dd_basename"，同一天里超过 rollSize 之后依次写
+// "yyyy-mm-dd_basename.1"、".2"……，过了0点换到新日期的文件。每隔 fsyncInterval 秒 fdatasync 一次
+class LogFile
+{
+public:
+    static const size_t kDefaultRollSize = 64 * 1024 * 1024; // 默认每个文件 64MB
+
+    // 日志写到以 basename 命名的文件，追加写入。fsyncInterval 为0表示每次写入后都落盘，小于0表示只在滚动和关闭时落盘
+    LogFile(const std::string& basename, size_t rollSize = kDefaultRollSize, int fsyncInterval = 3);
+
+    // 日志写到已经打开的 fd（比如标准错误），不滚动、不落盘，也不关闭 fd
+    explicit LogFile(int fd);
+
+    ~LogFile();
+
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+
+    // 设置文件头：每次打开文件（包括滚动和重启之后追加写）后，第一次写入之前先写 header() 返回的数据，
+    // 二进制日志用它让每个文件都带上调用点定义。只由日志线程调用，或者在日志线程开始使用这个文件之前调用
+    void setheader(std::function<std::string()> header);
+
+    // 文件是否打开成功
+    bool isopen() const;
+
+    // 把 iov 里的数据按顺序写到文件，超过 IOV_MAX 个数据段或者只写了一部分时继续写，直到写完或者出错；
+    // 写之前检查是否需要滚动，写完按 fsync 的节奏落盘。会修改 iov，只由日志线程调用
+    void append(struct iovec* iov, int iovcnt);
+
+    // 当前文件已经写入的字节数
+    size_t written() const;
+
+private:
+    // 打开 now 所在日期、序号为 m_index 的文件
+    bool open(time_t now);
+
+    // 关闭当前文件，打开下一个文件
+    void roll(time_t now);
+
+    // 把长度为 len 的 data 全部写到文件，返回是否成功
+    bool writeall(const char* data, size_t len);
+
+    // 获取当前日期、当前序号对应的文件名
+    std::string filename(time_t now) const;
+
+    // 获取 now 所在日期已经存在的最大序号，一个文件都没有时返回0。序号是连续的，从1开始逐个 stat 直到文件不存在
+    int lastindex(time_t now) const;
+
+    std::string m_basename;   // 文件名里日期后面的部分，为空表示写到外部传入的 fd
+    size_t m_rollsize;        // 单个文件的大小上限，超过之后滚动
+    int m_fsyncinterval;      // 落盘间隔（秒）
+    int m_fd = -1;
+    bool m_ownfd = true;      // fd 是否由 LogFile 打开和关闭
+    size_t m_written = 0;     // 当前文件的大小
+    int m_index = 0;          // 同一天里按大小滚动的序号，新的一天从0开始
+    time_t m_nextday = 0;     // 下一天0点，到了就按日期滚动
+    time_t m_lastsync = 0;    // 上一次落盘的时间
+    bool m_dirty = false;     // 上一次落盘之后是否写过数据
+    bool m_failed = false;    // 上一次写入是否出错，连续出错只报告一次
+    bool m_needheader = false; // 新打开的文件还没有写文件头
+    std::function<std::string()> m_header; // 生成文件头的回调函数
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// 无锁的多生产者单消费者队列
+// 生产者用 CAS 把节点压入一个原子栈；消费者用一次 exchange 把整批节点取走，再反转成入队顺序依次处理。
+// 因为取节点只有整批 exchange 这一种方式，不存在 ABA 问题，多个线程同时 consumeall 也是安全的
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : m_head(nullptr) {}
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+        while (node)
+        {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // 入队，返回入队前队列是否为空。调用者可以据此合并唤醒：只有第一个入队的生产者需要唤醒消费者
+    bool push(T value)
+    {
+        Node* node = new Node{std::move(value), m_head.load(std::memory_order_relaxed)};
+        while (!m_head.compare_exchange_weak(node->next, node, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+        }
+        return node->next == nullptr;
+    }
+
+    // 判断队列是否为空
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_seq_cst) == nullptr;
+    }
+
+    // 一次性取走当前队列里所有的元素，按入队顺序对每个元素调用 func，返回处理的元素个数
+    template <typename F>
+    size_t consumeall(F&& func)
+    {
+        Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+        // 栈里是后进先出的顺序，反转成先进先出
+        Node* reversed = nullptr;
+        while (node)
+        {
+            Node* next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        size_t cnt = 0;
+        while (reversed)
+        {
+            Node* next = reversed->next;
+            func(reversed->value);
+            delete reversed;
+            reversed = next;
+            ++cnt;
+        }
+        return cnt;
+    }
+
+private:
+    struct Node
+    {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> m_head; // 栈顶，指向最后一个入队的节点
+};
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// 按大小分级的内存块池，每个事件循环一个，用来分配连接相关的小对象（Socket、Channel、Connection）
+// 块按64字节分级，每一级有两个空闲链表：
+//   本地链表只由所属线程（事件循环所在的线程）访问，不需要加锁；
+//   远程链表是一个无锁栈，其他线程（例如工作线程释放最后一个 shared_ptr<Connection>）归还的块压到这里，
+//   本地链表用完时由所属线程一次性整个取走。
+// 非所属线程申请内存时直接向系统申请，释放时照常回到池里，保证任意线程分配、任意线程释放都是安全的
+class ObjectPool
+{
+public:
+    static const size_t kAlignSize = 64;   // 分级粒度，也是块的最小大小
+    static const size_t kMaxBlockSize = 1024; // 超过该大小的内存不经过内存池
+    static const size_t kMaxCached = 4096; // 每一级本地链表最多缓存的块数，超过的直接还给系统
+
+    ObjectPool();
+    ~ObjectPool();
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    // 把内存池绑定到当前线程，由事件循环在所在线程里调用
+    void bindthread();
+
+    // 申请 size 字节的内存，可以在任意线程调用
+    void* allocate(size_t size);
+
+    // 归还 allocate 申请的内存，size 必须和申请时相同，可以在任意线程调用
+    void deallocate(void* p, size_t size);
+
+private:
+    struct FreeNode
+    {
+        FreeNode* next;
+    };
+
+    struct SizeClass
+    {
+        FreeNode* local = nullptr;                  // 本地空闲链表，只由所属线程访问
+        size_t localcnt = 0;                        // 本地空闲链表的长度
+        std::atomic<FreeNode*> remote{nullptr};     // 其他线程归还的块
+    };
+
+    static const size_t kClassNums = kMaxBlockSize / kAlignSize;
+
+    static size_t classindex(size_t size) { return (size + kAlignSize - 1) / kAlignSize - 1; } // size 所在的级别
+    static size_t classsize(size_t index) { return (index + 1) * kAlignSize; }                // 该级别的块大小
+
+    bool isownerthread() const; // 当前线程是不是内存池所属的线程
+
+    std::atomic<std::thread::id> m_owner; // 内存池所属的线程
+    SizeClass m_classes[kClassNums];
+};
+
+// 从 ObjectPool 分配内存的分配器，配合 std::allocate_shared 使用：
+// 对象和 shared_ptr 的控制块在同一个块里，控制块里保存的分配器持有内存池，保证对象释放之前内存池不会被析构
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(std::shared_ptr<ObjectPool> pool) : m_pool(std::move(pool)) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : m_pool(other.m_pool) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "PoolAllocator does not support over-aligned types");
+        return static_cast<T*>(m_pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        m_pool->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const { return m_pool == other.m_pool; }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const { return m_pool != other.m_pool; }
+
+private:
+    template <typename U>
+    friend class PoolAllocator;
+
+    std::shared_ptr<ObjectPool> m_pool;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <cstdint>
+#include <memory>
+
+class Channel; // 向前声明Channel类
+struct msghdr;
+
+// 完成式 I/O 的完成事件，和 epoll 的事件位不重叠，和就绪事件一样放在 epoll_event 的 events 里返回
+constexpr uint32_t kRecvDone = 1u << 24; // Channel 提交的 recv 请求完成了，结果见 Channel::setrecvresult
+constexpr uint32_t kSendDone = 1u << 25; // Channel 提交的 sendmsg 请求完成了，结果见 Channel::setsendresult
+
+// 就绪事件视图，直接指向 Poller 内部的事件数组，既不拷贝也不分配内存。
+// 各种 Poller 都把就绪事件整理成 epoll_event 的格式，data.ptr 指向对应的Channel。视图只在下一次等待事件之前有效
+class EpollEvents
+{
+public:
+    EpollEvents(const struct epoll_event* evs = nullptr, int cnt = 0)
+        : m_evs(evs), m_cnt(cnt) {}
+
+    const struct epoll_event* begin() const { return m_evs; }
+    const struct epoll_event* end() const { return m_evs + m_cnt; }
+    int size() const { return m_cnt; }
+    bool empty() const { return m_cnt == 0; }
+
+private:
+    const struct epoll_event* m_evs; // 指向 Poller 内部事件数组的首个就绪事件
+    int m_cnt;                       // 就绪事件的个数
+};
+
+// I/O 多路复用的后端
+enum class PollerType
+{
+    Epoll,   // epoll，默认
+    IoUring, // io_uring，内核不支持时退回 epoll
+};
+
+// I/O 多路复用的抽象接口，每个事件循环持有一个
+class Poller
+{
+public:
+    virtual ~Poller() = default;
+
+    // 按照Channel的m_events属性添加或修改监视的事件
+    virtual int updatechannel(Channel* pchannel) = 0;
+
+    // 将Channel从监视中移除
+    virtual int removechannel(Channel* pchannel) = 0;
+
+    /**
+     * @brief 等待事件发生,设置超时时间
+     *
+     * @param timeout 超时时间（毫秒），-1表示一直等待。传入传出参数，若传出值为-1，说明发生了错误，若传出值为0，说明没有发生错误。
+     * @return EpollEvents 就绪事件的视图。若为空，说明发生了错误或者超时时间到，需要结合timeout的传出值来区分。
+     */
+    virtual EpollEvents poll(int& timeout) = 0;
+
+    // 是否支持完成式 I/O：连接的 recv/sendmsg 作为请求提交，和下一次等待合并成一次系统调用，完成之后以 kRecvDone/kSendDone 事件返回。
+    // 不支持时连接按就绪事件自己调用 recv/sendmsg
+    virtual bool asyncio() const { return false; }
+
+    // 为Channel提交一个 recv 请求，每个Channel同时最多一个。数据读进 Poller 管理的接收缓冲区，只在下一次等待之前有效
+    virtual void submitrecv(Channel* /* pchannel */) {}
+
+    // 为Channel提交一个 sendmsg 请求，每个Channel同时最多一个。msg 和它引用的数据在请求完成之前必须有效，
+    // keepalive 由 Poller 持有到请求完成，Channel 被移除之后也一样
+    virtual void submitsendmsg(Channel* /* pchannel */, const struct msghdr* /* msg */, int /* flags */, std::shared_ptr<void> /* keepalive */) {}
+
+    // 工厂函数，创建 type 类型的 Poller。io_uring 初始化失败时记录日志并退回 epoll
+    static std::unique_ptr<Poller> create(PollerType type);
+};
@@ -25,6 +25,12 @@ public:
     // 设置套接字的 SO_KEEPALIVE 属性
     int setkeepaliveopt();
 
+    // 设置套接字的 SO_ZEROCOPY 属性，之后带 MSG_ZEROCOPY 的发送才会真正零拷贝并产生完成通知
+    int setzerocopyopt();
+
+    // 关闭写端：内核发送缓冲区里的数据发完之后发送 FIN，套接字仍然可以读
+    int shutdownwrite();
+
     // 静态工厂方法，返回监听套接字对象
     static Socket* getlistenfd();
 
@@ -6,12 +6,16 @@
 #include "Acceptor.h"
 #include "Buffer.h"
 
-#include <unordered_map>
 
 class TcpServer
 {
 public:
-    TcpServer(const std::string& ip, uint16_t port, uint16_t nums = 3);
+    // reuseport 为 true 时，每个从事件循环各自持有一个绑定了 SO_REUSEPORT 的监听套接字，
+    // 由内核把新连接分散到各个从事件循环，连接的建立和后续的I/O都在同一个I/O线程内完成，主事件循环不再参与accept
+    // poller 指定所有事件循环使用的 I/O 多路复用后端，io_uring 不可用时自动退回 epoll
+    // iocpus 不为空时，第 i 个从事件循环的I/O线程绑定到 iocpus[i % iocpus.size()]，事件循环和它的连接不会在CPU（NUMA节点）之间迁移
+    TcpServer(const std::string& ip, uint16_t port, uint16_t nums = 3, bool reuseport = false, PollerType poller = PollerType::Epoll,
+              std::vector<int> iocpus = {});
     ~TcpServer();
 
     // 启动服务器
@@ -20,10 +24,10 @@ public:
     // 关闭服务器
     void stop();
 
-    // 创建Connection对象
-    void createconnection(const std::shared_ptr<Socket>& pClientSocket);
+    // 创建Connection对象，ploop 为负责该连接的从事件循环，在 ploop 所在的I/O线程中调用
+    void createconnection(const std::shared_ptr<Socket>& pClientSocket, EventLoop* ploop);
 
-    // 从clientConnectionMap中删除指定主键的Connection对象
+    // 从事件循环删除Connection对象之后调用，通知上层
     void deleteconnection(int fd);
 
     // 处理Connection对象接收到的客户端发送过来的一条完整的数据
@@ -50,22 +54,49 @@ public:
     // 给 函数对象 m_handleeventlooptimeout 赋值
     void sethandleeventlooptimeout(std::function<void(EventLoop*)> func);
 
-    // 从 m_clientConnectionMap 移除超时的Connection连接，由EventLoop对象通过回调的方式调用
-    void removeTimeOutConnection(int fd);
+    // 设置所有事件循环的空闲超时时间（毫秒），到期调用 m_handleeventlooptimeout，小于0表示不启用（默认）
+    void setidletimeout(int ms);
+
+    // 设置从事件循环的忙轮询预算，0表示不启用（默认）。适合对唤醒延迟敏感、CPU充足的部署
+    void setbusypoll(std::chrono::microseconds budget);
+
+    // 设置新连接的零拷贝发送阈值，0表示不启用（默认）。只影响之后建立的连接，见 Connection::setzerocopy
+    void setzerocopy(size_t threshold);
+
+    // 设置新连接写缓冲区的高、低水位线，high 为0表示不启用（默认）。只影响之后建立的连接，见 Connection::setwatermark
+    void setwatermark(size_t high, size_t low);
+
+    // 设置新连接读缓冲区的上限，0表示不限制（默认）。只影响之后建立的连接，见 Connection::setinputlimit
+    void setinputlimit(size_t limit);
+
+    // 给 函数对象 m_handlehighwatermark 赋值
+    void sethandlehighwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func);
+
+    // 给 函数对象 m_handlelowwatermark 赋值
+    void sethandlelowwatermark(std::function<void(std::shared_ptr<Connection>, size_t)> func);
+
+    // 获取所有从事件循环持有的连接总数，可以在任意线程调用。每个从事件循环各自管理自己的连接，只在这里汇总
+    size_t connectionCount() const;
 
 private:
     std::unique_ptr<EventLoop> m_pmainloop;               // 主事件循环, 只负责客户端建立新连接的请求
-    Acceptor m_acceptor;                                  // 连接器
+    bool m_reuseport;                                     // 是否为每个从事件循环单独创建 SO_REUSEPORT 连接器
+    std::unique_ptr<Acceptor> m_acceptor;                 // 主事件循环上的连接器，reuseport 模式下为空
     std::vector<std::unique_ptr<EventLoop>> m_psubloop;   // 从事件循环，负责已建立连接的客户端的I/O请求
+    std::vector<std::unique_ptr<Acceptor>> m_subacceptors;// reuseport 模式下，每个从事件循环各自的连接器
     uint16_t m_threadsnums;                               // 子线程个数，同时也是从事件循环的个数
     ThreadPool m_threadpool;                              // 线程池，里面的每个线程负责运行一个事件循环
-    std::unordered_map<int, std::shared_ptr<Connection>> m_clientConnectionMap; // 记录套接字和Connection连接的映射
-    std::mutex m_mtx;
+    std::atomic<size_t> m_zerocopythreshold{0};           // 新连接的零拷贝发送阈值，0表示不启用
+    std::atomic<size_t> m_highwatermark{0};               // 新连接写缓冲区的高水位线，0表示不启用
+    std::atomic<size_t> m_lowwatermark{0};                // 新连接写缓冲区的低水位线
+    std::atomic<size_t> m_inputlimit{0};                  // 新连接读缓冲区的上限，0表示不限制
 
-    // 下面的 5 个回调函数，都是用于TCPServer类调用它的上层类的函数
-    std::function<void(const std::shared_ptr<Socket>)> m_handlecreateconnectioncb; // 回调函数，建立新的Connection连接
+    // 下面的 7 个回调函数，都是用于TCPServer类调用它的上层类的函数
+    std::function<void(const std::shared_ptr<Socket>)> m_handlecreateconnectioncb; // 回调函数，建立新的Connection连接，在该连接的I/O线程中调用
     std::function<void(int)> m_handledeleteconnectioncb; // 回调函数，删除Connection连接
     std::function<void(std::shared_ptr<Connection>, Buffer*)> m_handlemessage; // 回调函数，处理客户端发送过来的数据
     std::function<void(std::shared_ptr<Connection>)> m_handlesendcomplete; // 回调函数，完成处理结果发送给客户端之后的业务逻辑
     std::function<void(EventLoop*)> m_handleeventlooptimeout; // 回调函数，处理事件循环超时
+    std::function<void(std::shared_ptr<Connection>, size_t)> m_handlehighwatermark; // 回调函数，连接的写缓冲区积压到高水位线
+    std::function<void(std::shared_ptr<Connection>, size_t)> m_handlelowwatermark; // 回调函数，连接的写缓冲区回落到低水位线
 };
\ No newline at end of file
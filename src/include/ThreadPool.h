@@ -1,45 +1,129 @@
 #pragma once
 #include "Log.h"
+#include "MpscQueue.h"
 
 #include <sys/syscall.h> // SYS_gettid
 #include <unistd.h>      // syscall 原型
 #include <vector>
-#include <queue>
+#include <deque>
+#include <memory>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
 #include <functional>
 
+// 任务窃取线程池
+// 每个线程有一个无锁的收件箱和一个本地双端队列：
+//   其他线程（例如I/O线程）提交的任务轮流压入各个线程的收件箱，提交路径上没有锁；
+//   线程池里的线程自己提交的任务直接放进自己的本地队列；
+//   线程先从本地队列头部取任务，本地队列空了把收件箱里的任务整批搬进本地队列；
+//   自己没有任务时，从其他线程的本地队列尾部窃取一半，或者整批取走其他线程收件箱里的任务。
+// 所有地方都找不到任务时线程挂起在条件变量上，直到有新任务提交或者线程池停止，不再定时醒来轮询。
+// 有序任务按 key 散列到槽位，每个槽位绑定到一个线程，放进这个线程的有序队列，不会被窃取：
+//   同一个 key 的任务按提交顺序在同一个线程里依次执行，处理函数里不用加锁；
+//   槽位上没有未完成的任务时，如果绑定的线程积压太多，可以把槽位迁移到积压最少的线程
 class ThreadPool
 {
 public:
-    // 启动 num 个线程
-    ThreadPool(size_t num, const std::string& type = "IO");
+    static const size_t kOrderedSlots = 4096; // 有序任务的槽位个数，key 相同或者同余的任务共用一个槽位
+
+    // 启动 num 个线程。cpus 不为空时，第 i 个线程绑定到 cpus[i % cpus.size()] 这个CPU上运行，
+    // 绑定在线程启动后、分配任何内存之前完成，线程里首次访问的内存都落在该CPU所在的NUMA节点上
+    ThreadPool(size_t num, const std::string& type = "IO", std::vector<int> cpus = {});
 
     // 返回线程池的大小
     size_t size();
 
-    // 将任务添加到任务队列中
+    // 将任务添加到任务队列中，可以在任意线程调用
     template <typename F>
     void AddTask(F &&f)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_tasksqueue.emplace(std::forward<F>(f));
-        m_condition.notify_one();
+        submit(std::function<void()>(std::forward<F>(f)));
+    }
+
+    // 添加一个有序任务，可以在任意线程调用。key 相同的任务按提交顺序执行，同一时刻只有一个在执行，
+    // 例如用连接的 fd 做 key，同一个连接的消息总是在同一个线程里按顺序处理
+    template <typename F>
+    void AddOrderedTask(size_t key, F &&f)
+    {
+        submitordered(key, std::function<void()>(std::forward<F>(f)));
     }
-    
-    // 停止线程池里的所有线程
+
+    // 某个线程的有序队列积压超过 depth 个任务时，允许把空闲的槽位迁移到积压最少的线程，0 表示不迁移（默认）
+    void setrebalancedepth(size_t depth);
+
+    // 停止线程池里的所有线程，已经提交的任务会先执行完
     void stop();
 
     // 在析构函数中停止线程池的工作
     ~ThreadPool();
 
 private:
+    struct OrderedTask
+    {
+        size_t slot;                // 任务所属的槽位，执行完后减少槽位上未完成的任务数
+        std::function<void()> func;
+    };
+
+    struct Worker
+    {
+        MpscQueue<std::function<void()>> inbox;   // 其他线程提交的任务，无锁
+        std::mutex mutex;                         // 保护本地队列，只有窃取时才会有竞争
+        std::deque<std::function<void()>> local;  // 本地队列，所属线程从头部取，其他线程从尾部窃取
+        std::atomic<size_t> localsize{0};         // 本地队列的长度，窃取前先看一眼，不用为空队列加锁
+        MpscQueue<OrderedTask> orderedinbox;      // 绑定到这个线程的有序任务，无锁
+        std::deque<OrderedTask> ordered;          // 从 orderedinbox 搬过来的有序任务，只有所属线程访问
+        std::atomic<size_t> orderedsize{0};       // 还没执行完的有序任务个数，用于判断积压
+        bool orderedfirst = false;                // 有序任务和普通任务轮流优先，谁都不会饿死
+        std::atomic<bool> parked{false};          // 准备挂起或者已经挂起，提交有序任务时据此决定是否需要唤醒
+    };
+
+    // 提交一个任务
+    void submit(std::function<void()> task);
+
+    // 提交一个有序任务
+    void submitordered(size_t key, std::function<void()> task);
+
+    // 执行第 index 个线程的下一个有序任务，没有返回 false
+    bool runordered(size_t index);
+
+    // 有序队列积压最少的线程
+    size_t leastloaded() const;
+
+    // 线程的主循环
+    void run(size_t index);
+
+    // 把第 index 个线程绑定到 m_cpus 里对应的CPU上，成功返回绑定的CPU，没有指定或者失败返回-1
+    int bindcpu(size_t index);
+
+    // 为第 index 个线程找一个任务：本地队列 -> 自己的收件箱 -> 窃取其他线程的任务，找不到返回 false
+    bool findtask(size_t index, std::function<void()>& task);
+
+    // 从本地队列头部取一个任务
+    bool popLocal(size_t index, std::function<void()>& task);
+
+    // 把收件箱里的任务整批搬进第 index 个线程的本地队列，返回搬过来的任务个数
+    size_t drainInbox(Worker& from, size_t index);
+
+    // 从第 victim 个线程窃取任务放进第 index 个线程的本地队列，返回窃取的任务个数
+    size_t steal(size_t victim, size_t index);
+
+    // 有挂起的线程时唤醒其中一个
+    void wakeone();
+
+    std::vector<std::unique_ptr<Worker>> m_workers; // 每个线程的任务队列
     std::vector<std::thread> m_threads;             // 线程池
-    std::queue<std::function<void()>> m_tasksqueue; // 任务队列
-    std::mutex m_mutex;                              
-    std::condition_variable m_condition;            
+    std::atomic<size_t> m_next;                     // 外部提交任务时轮流选择的收件箱
+    std::atomic<uint64_t> m_epoch;                  // 每提交一个任务加一，挂起的线程据此判断是否有新任务
+    std::atomic<int> m_idle;                        // 准备挂起或者已经挂起的线程个数
+    std::mutex m_mutex;                             // 配合条件变量挂起线程
+    std::condition_variable m_condition;
+    // 每个槽位的高 32 位是绑定的线程下标，低 32 位是槽位上还没执行完的任务数，打包在一起用 CAS 更新，
+    // 保证只有在没有未完成任务时才会改变绑定的线程
+    std::unique_ptr<std::atomic<uint64_t>[]> m_slots;
+    std::atomic<size_t> m_rebalancedepth;           // 触发槽位迁移的积压深度，0 表示不迁移
     std::atomic<bool> m_stop;                       // 控制线程池是否停止工作的按钮
     std::string m_type;                             // 线程池的类型，I/O线程或者WORK线程
-};
\ No newline at end of file
+    std::vector<int> m_cpus;                        // 线程绑定的CPU，为空表示不绑定
+};
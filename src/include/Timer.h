@@ -18,6 +18,9 @@ public:
     // 读取timerfd的数据
     void wait();
 
+    // 重新设置闹钟：first 后首次超时，之后每隔 interval 超时一次。first 为0表示关闭闹钟，interval 为0表示只响一次
+    void settime(std::chrono::nanoseconds first, std::chrono::nanoseconds interval = std::chrono::nanoseconds(0));
+
 private:
     int m_timerfd;
     // 将 ns 转换成 struct itimerspec
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Timer.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class EventLoop;
+class Channel;
+struct TimerNode;
+
+// 定时器句柄，由 runAt/runAfter/runEvery 返回，用于取消定时器。定时器到期或被取消后句柄自动失效
+class TimerId
+{
+public:
+    TimerId() = default;
+
+private:
+    friend class TimerQueue;
+    explicit TimerId(std::weak_ptr<TimerNode> pnode) : m_pnode(std::move(pnode)) {}
+
+    std::weak_ptr<TimerNode> m_pnode;
+};
+
+// 事件循环的定时器队列。所有定时器共用一个 timerfd，按到期时间组织成最小堆：
+// 插入和取消都是 O(log n)，只有堆顶变化时才需要重新设置 timerfd，单个定时器不产生系统调用
+class TimerQueue
+{
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    explicit TimerQueue(EventLoop* ploop);
+    ~TimerQueue();
+
+    // 添加定时器，在 when 时刻执行 cb；interval 大于0时，之后每隔 interval 执行一次。可以在任意线程调用
+    TimerId addTimer(TimePoint when, std::chrono::nanoseconds interval, std::function<void()> cb);
+
+    // 取消定时器，可以在任意线程调用。定时器已经到期或已经取消时什么也不做
+    void cancel(const TimerId& id);
+
+    // 返回当前还未到期的定时器个数
+    size_t size() const;
+
+private:
+    // 在I/O线程中把定时器放入堆中
+    void insert(std::shared_ptr<TimerNode> pnode);
+
+    // 在I/O线程中把定时器从堆中移除
+    void remove(const std::shared_ptr<TimerNode>& pnode);
+
+    // timerfd 可读时的回调函数，执行所有到期的定时器
+    void handleRead();
+
+    // 让 timerfd 在堆顶定时器到期时响
+    void rearm();
+
+    void push(std::shared_ptr<TimerNode> pnode);   // 入堆
+    std::shared_ptr<TimerNode> pop(size_t index);  // 取出堆中下标为index的定时器
+    void siftup(size_t index);
+    void siftdown(size_t index);
+    bool before(size_t a, size_t b) const;         // 堆中下标为a的定时器是否比下标为b的先到期
+    void swapnode(size_t a, size_t b);
+
+    EventLoop* m_ploop;
+    Timer m_timer;                                      // 所有定时器共用的 timerfd
+    std::unique_ptr<Channel> m_ptimerchannel;           // timerfd 所对应的Channel
+    std::vector<std::shared_ptr<TimerNode>> m_heap;     // 按到期时间排序的最小堆
+    std::vector<std::shared_ptr<TimerNode>> m_expired;  // 本轮到期的定时器，复用内存避免每次分配
+    uint64_t m_sequence = 0;                            // 定时器序号，到期时间相同时先加入的先执行
+    TimePoint m_armed;                                  // timerfd 当前设置的到期时间
+    bool m_isarmed = false;                             // timerfd 当前是否设置了闹钟
+};
\ No newline at end of file